@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "RbTree.hpp"
+
+namespace ads {
+
+/// `BufferedRbTree` puts an append buffer in front of an `RbTree`, like a memtable of an LSM tree.
+/// Writes go to the end of the buffer. A full buffer is sorted and merged into the tree in one
+/// pass in the order of keys, so consecutive descents share the cached top of their paths. The
+/// gain grows with the part of the tree a merge covers, while `Find` scans the whole buffer
+/// first, so the capacity trades insert throughput for lookup latency.
+///
+/// A later write of a key replaces an earlier one, like `InsertOrUpdate`. `Size` and `Tree` merge
+/// the buffer first. Merging doesn't change the contents, so they are const, but a const tree
+/// can't be read by several threads at once.
+template <typename V,
+          typename Cmp = std::less<typename internal::KeyValueType<V>::key_type>,
+          typename StatsPolicy = NoStats>
+class BufferedRbTree {
+public:
+    using key_value_type = V;
+    using key_type = typename internal::KeyValueType<V>::key_type;
+    using compare = Cmp;
+    using size_type = std::size_t;
+    using TreeType = RbTree<V, Cmp, StatsPolicy>;
+
+    static constexpr size_type kDefaultCapacity = 256;
+
+public:
+    explicit BufferedRbTree(size_type capacity = kDefaultCapacity) : m_capacity{capacity} {
+        m_buffer.reserve(capacity);
+    }
+
+public:
+    /// Size returns current number of elements, the buffer is merged first.
+    size_type Size() const {
+        Merge();
+        return m_tree.Size();
+    }
+
+    /// Empty returns true if size of container is 0, false otherwise.
+    bool Empty() const noexcept { return m_buffer.empty() && m_tree.Empty(); }
+
+    /// Clear removes all elements from the container.
+    void Clear() noexcept {
+        m_buffer.clear();
+        m_tree.Clear();
+    }
+
+    /// Tree returns the underlying tree with all buffered writes merged into it.
+    const TreeType& Tree() const {
+        Merge();
+        return m_tree;
+    }
+
+public:
+    /// InsertOrUpdate appends `val` to the buffer, a full buffer is merged into the tree.
+    void InsertOrUpdate(const key_value_type& val) {
+        m_buffer.push_back(val);
+        if (m_buffer.size() >= m_capacity) {
+            Flush();
+        }
+    }
+
+    /// Find returns the latest value of `key` or `nullptr`. The buffer is scanned from the newest
+    /// write, then the tree is searched. The value may live in the buffer, so the pointer is valid
+    /// only until the next call of anything but `Find`, `Contains` and `Empty`: the rest may merge
+    /// or change the buffer.
+    const key_value_type* Find(const key_type& key) const noexcept {
+        for (auto it = m_buffer.rbegin(); it != m_buffer.rend(); ++it) {
+            if (Equal(key, internal::Key(*it))) {
+                return &*it;
+            }
+        }
+        const auto pNode = m_tree.Find(key);
+        return pNode ? &pNode->m_value : nullptr;
+    }
+
+    /// Contains returns true if there is an element with `key`.
+    bool Contains(const key_type& key) const noexcept { return Find(key) != nullptr; }
+
+    /// `Remove` removes an element with `key` from the buffer and from the tree.
+    void Remove(const key_type& key) {
+        std::erase_if(m_buffer, [this, &key](const key_value_type& val) {
+            return Equal(key, internal::Key(val));
+        });
+        m_tree.Remove(key);
+    }
+
+    /// Flush merges buffered writes into the tree.
+    void Flush() { Merge(); }
+
+private:
+    // `Merge` moves buffered writes into the tree, the contents stay the same.
+    void Merge() const {
+        if (m_buffer.empty()) {
+            return;
+        }
+
+        const auto less = [this](const key_value_type& lhs, const key_value_type& rhs) {
+            return Less(internal::Key(lhs), internal::Key(rhs));
+        };
+        // a stable sort keeps writes of one key in order, only the last one is merged
+        std::stable_sort(m_buffer.begin(), m_buffer.end(), less);
+        auto last = m_buffer.begin();
+        for (auto it = m_buffer.begin(); it != m_buffer.end(); ++it) {
+            if (last != it && less(*last, *it)) {
+                ++last;
+            }
+            if (last != it) {
+                *last = std::move(*it);
+            }
+        }
+
+        for (auto it = m_buffer.begin(); it != std::next(last); ++it) {
+            m_tree.InsertOrUpdate(*it);
+        }
+        m_buffer.clear();
+    }
+
+    bool Less(const key_type& lhs, const key_type& rhs) const noexcept {
+        if constexpr (internal::IsThreeWayCompare<compare, key_type>) {
+            return m_compare(lhs, rhs) < 0;
+        } else {
+            return m_compare(lhs, rhs);
+        }
+    }
+
+    bool Equal(const key_type& lhs, const key_type& rhs) const noexcept {
+        return !Less(lhs, rhs) && !Less(rhs, lhs);
+    }
+
+private:
+    mutable TreeType m_tree;
+    mutable std::vector<key_value_type> m_buffer;  // writes in the order of arrival
+    size_type m_capacity;
+    [[no_unique_address]] compare m_compare{};
+};
+
+}  // namespace ads
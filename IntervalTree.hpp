@@ -0,0 +1,220 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "RbTree.hpp"
+
+namespace ads {
+
+/// `Interval` is a closed interval `[m_low, m_high]`.
+template <typename P>
+struct Interval {
+    P m_low;
+    P m_high;
+
+    bool operator==(const Interval&) const = default;
+};
+
+/// `IntervalTree` is a red-black tree of intervals with values, ordered by starts of intervals.
+/// Every node also keeps the max end of intervals in its subtree, it is maintained through
+/// rotations and both rebalancing fixups, so a query skips subtrees, which end before it. Equal
+/// intervals are allowed.
+///
+/// `Cmp` must be stateless: max ends are updated inside rotations, which don't see the tree, so
+/// they compare with a default-constructed `Cmp`.
+template <typename P, typename T, typename Cmp = std::less<P>>
+class IntervalTree : private internal::TreeHeader {
+    static_assert(std::is_empty_v<Cmp> && std::is_default_constructible_v<Cmp>,
+                  "IntervalTree needs a stateless comparator");
+
+public:
+    using point_type = P;
+    using interval_type = Interval<P>;
+    using value_type = T;
+    using compare = Cmp;
+    using size_type = std::size_t;
+
+    /// `Entry` is an interval and its value.
+    struct Entry {
+        interval_type m_interval;
+        T m_value;
+    };
+
+private:
+    struct Node : public internal::NodeBase {
+        Entry m_entry;
+        P m_maxHigh;  // the max end of intervals in the subtree
+    };
+
+    using BasePtr = internal::NodeBase*;
+    using NodePtr = Node*;
+
+    // `MaxHighAugment` recomputes the max end of the subtree of a node from its children.
+    struct MaxHighAugment {
+        static constexpr bool kEnabled = true;
+
+        static void Update(BasePtr pBase) noexcept {
+            NodePtr pNode = static_cast<NodePtr>(pBase);
+            const P* pMax = &pNode->m_entry.m_interval.m_high;
+            for (BasePtr pChild : pNode->m_child) {
+                if (pChild && Cmp{}(*pMax, static_cast<NodePtr>(pChild)->m_maxHigh)) {
+                    pMax = &static_cast<NodePtr>(pChild)->m_maxHigh;
+                }
+            }
+            pNode->m_maxHigh = *pMax;
+        }
+    };
+
+public:
+    IntervalTree() = default;
+
+    IntervalTree(const IntervalTree&) = delete;
+    IntervalTree& operator=(const IntervalTree&) = delete;
+
+    IntervalTree(IntervalTree&& other) noexcept { TakeFrom(other); }
+
+    IntervalTree& operator=(IntervalTree&& other) noexcept {
+        if (this != std::addressof(other)) {
+            Clear();
+            TakeFrom(other);
+        }
+        return *this;
+    }
+
+    /// Destructor removes all nodes of a tree.
+    ~IntervalTree() { Clear(); }
+
+public:
+    /// Size returns current number of intervals.
+    size_type Size() const noexcept { return m_size; }
+
+    /// Empty returns true if size of container is 0, false otherwise.
+    bool Empty() const noexcept { return m_size == 0; }
+
+    /// Clear removes all intervals from the container.
+    void Clear() noexcept {
+        DestroySubtree(Root());
+        m_endNode.m_pParent = nullptr;
+        m_endNode.m_child[internal::kLeft] = nullptr;
+        m_endNode.m_child[internal::kRight] = nullptr;
+        m_size = 0;
+    }
+
+public:
+    /// Insert adds `interval` with `value`, equal intervals are kept after existing ones.
+    Entry& Insert(const interval_type& interval, T value) {
+        BasePtr pCurrNode = m_endNode.m_pParent;
+        BasePtr pParentNode = nullptr;  // this node will be a parent of a new node
+        std::size_t dir = internal::kLeft;
+
+        while (pCurrNode) {
+            pParentNode = pCurrNode;
+            dir = Less(interval, IntervalOf(pCurrNode)) ? internal::kLeft : internal::kRight;
+            pCurrNode = pCurrNode->m_child[dir];
+        }
+
+        NodePtr pNode = new Node{{}, Entry{interval, std::move(value)}, interval.m_high};
+        internal::LinkNode<NoStats, MaxHighAugment>(*this, pParentNode, dir, pNode);
+        return pNode->m_entry;
+    }
+
+    /// `Remove` removes one interval equal to `interval`, returns false if there is no such one.
+    bool Remove(const interval_type& interval) {
+        BasePtr pCurrNode = m_endNode.m_pParent;
+        // the last node, which is not less than `interval`, only it can be equal to it
+        BasePtr pCandidate = nullptr;
+
+        while (pCurrNode) {
+            if (Less(IntervalOf(pCurrNode), interval)) {
+                pCurrNode = pCurrNode->m_child[internal::kRight];
+            } else {
+                pCandidate = pCurrNode;
+                pCurrNode = pCurrNode->m_child[internal::kLeft];
+            }
+        }
+
+        if (!pCandidate || Less(interval, IntervalOf(pCandidate))) {
+            return false;
+        }
+        internal::UnlinkNode<NoStats, MaxHighAugment>(*this, pCandidate);
+        delete static_cast<NodePtr>(pCandidate);
+        return true;
+    }
+
+    /// Overlapping calls `fn(const Entry&)` for every interval, which overlaps `[low, high]`, in
+    /// the ascending order of starts. Subtrees ending before `low` and starting after `high`
+    /// are skipped, so it takes O(min(n, (k + 1) * log n)) for `k` reported intervals.
+    template <typename Fn>
+    void Overlapping(const P& low, const P& high, Fn&& fn) const {
+        Overlapping(Root(), low, high, fn);
+    }
+
+    /// Stabbing calls `fn(const Entry&)` for every interval, which contains `point`.
+    template <typename Fn>
+    void Stabbing(const P& point, Fn&& fn) const {
+        Overlapping(Root(), point, point, fn);
+    }
+
+private:
+    NodePtr Root() const noexcept { return static_cast<NodePtr>(m_endNode.m_pParent); }
+
+    static const interval_type& IntervalOf(BasePtr pNode) noexcept {
+        return static_cast<NodePtr>(pNode)->m_entry.m_interval;
+    }
+
+    // intervals are ordered by starts, then by ends
+    bool Less(const interval_type& lhs, const interval_type& rhs) const noexcept {
+        if (m_compare(lhs.m_low, rhs.m_low)) {
+            return true;
+        }
+        return !m_compare(rhs.m_low, lhs.m_low) && m_compare(lhs.m_high, rhs.m_high);
+    }
+
+    template <typename Fn>
+    void Overlapping(NodePtr pNode, const P& low, const P& high, Fn& fn) const {
+        // nothing in a subtree ends at `low` or later
+        while (pNode && !m_compare(pNode->m_maxHigh, low)) {
+            Overlapping(static_cast<NodePtr>(pNode->m_child[internal::kLeft]), low, high, fn);
+
+            const interval_type& interval = pNode->m_entry.m_interval;
+            if (m_compare(high, interval.m_low)) {
+                return;  // this node and its right subtree start after `high`
+            }
+            if (!m_compare(interval.m_high, low)) {
+                fn(std::as_const(pNode->m_entry));
+            }
+            pNode = static_cast<NodePtr>(pNode->m_child[internal::kRight]);
+        }
+    }
+
+    void DestroySubtree(NodePtr pNode) noexcept {
+        while (pNode) {
+            DestroySubtree(static_cast<NodePtr>(pNode->m_child[internal::kRight]));
+            NodePtr pLeft = static_cast<NodePtr>(pNode->m_child[internal::kLeft]);
+            delete pNode;
+            pNode = pLeft;
+        }
+    }
+
+    void TakeFrom(IntervalTree& other) noexcept {
+        if (other.m_size == 0) {
+            return;
+        }
+        m_endNode = other.m_endNode;
+        m_endNode.m_pParent->m_pParent = &m_endNode;
+        m_size = other.m_size;
+        other.m_endNode.m_pParent = nullptr;
+        other.m_endNode.m_child[internal::kLeft] = nullptr;
+        other.m_endNode.m_child[internal::kRight] = nullptr;
+        other.m_size = 0;
+    }
+
+private:
+    [[no_unique_address]] compare m_compare{};
+};
+
+}  // namespace ads
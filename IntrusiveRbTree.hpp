@@ -0,0 +1,301 @@
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "RbTree.hpp"
+
+namespace ads {
+
+/// `IntrusiveHook` holds links of an object in an `IntrusiveRbTree`. Objects derive from it, a
+/// different `Tag` per hook lets one object be linked into several trees at once.
+template <typename Tag = void>
+struct IntrusiveHook : public internal::NodeBase {};
+
+/// `IntrusiveRbTree` is a red-black tree of objects, which live somewhere else, e.g. in a pool. An
+/// object is linked by its `IntrusiveHook<Tag>` base, so `Insert` and `Remove` don't allocate or
+/// copy anything. `KeyOf` returns a key of an object.
+///
+/// The tree doesn't own objects: an object must stay alive and keep its key while it is linked,
+/// and it can be linked into one tree per hook only.
+template <typename T, typename KeyOf, typename Cmp = std::less<>, typename Tag = void>
+class IntrusiveRbTree : private internal::TreeHeader {
+public:
+    using value_type = T;
+    using key_type = std::remove_cvref_t<std::invoke_result_t<const KeyOf&, const T&>>;
+    using compare = Cmp;
+    using size_type = std::size_t;
+
+    using HookType = IntrusiveHook<Tag>;
+    using BasePtr = internal::NodeBase*;
+
+    static_assert(std::is_base_of_v<HookType, T>, "T must derive from ads::IntrusiveHook<Tag>");
+
+    /// `BasicIterator` walks linked objects in the ascending order of keys. `Iterator` gives
+    /// mutable objects and converts to `ConstIterator`, which gives const ones.
+    template <typename Object>
+    class BasicIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::remove_const_t<Object>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Object*;
+        using reference = Object&;
+
+        BasicIterator() noexcept = default;
+
+        operator BasicIterator<const T>() const noexcept
+            requires(!std::is_const_v<Object>)
+        {
+            return BasicIterator<const T>{m_pNode};
+        }
+
+        reference operator*() const noexcept { return *ObjectOf(m_pNode); }
+        pointer operator->() const noexcept { return ObjectOf(m_pNode); }
+
+        BasicIterator& operator++() noexcept {
+            m_pNode = internal::Next(m_pNode);
+            return *this;
+        }
+
+        BasicIterator operator++(int) noexcept {
+            BasicIterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const BasicIterator& other) const noexcept {
+            return m_pNode == other.m_pNode;
+        }
+        bool operator!=(const BasicIterator& other) const noexcept {
+            return m_pNode != other.m_pNode;
+        }
+
+    private:
+        friend class IntrusiveRbTree;
+        template <typename>
+        friend class BasicIterator;
+
+        explicit BasicIterator(const internal::NodeBase* pNode) noexcept
+            : m_pNode{const_cast<BasePtr>(pNode)} {}
+
+    private:
+        BasePtr m_pNode = nullptr;
+    };
+
+    using Iterator = BasicIterator<T>;
+    using ConstIterator = BasicIterator<const T>;
+
+public:
+    IntrusiveRbTree() = default;
+
+    explicit IntrusiveRbTree(KeyOf keyOf, Cmp cmp = Cmp{})
+        : m_keyOf{std::move(keyOf)}, m_compare{std::move(cmp)} {}
+
+    IntrusiveRbTree(const IntrusiveRbTree&) = delete;
+    IntrusiveRbTree& operator=(const IntrusiveRbTree&) = delete;
+
+    IntrusiveRbTree(IntrusiveRbTree&& other) noexcept
+        : m_keyOf{std::move(other.m_keyOf)}, m_compare{std::move(other.m_compare)} {
+        TakeFrom(other);
+    }
+
+    IntrusiveRbTree& operator=(IntrusiveRbTree&& other) noexcept {
+        if (this != std::addressof(other)) {
+            Clear();
+            m_keyOf = std::move(other.m_keyOf);
+            m_compare = std::move(other.m_compare);
+            TakeFrom(other);
+        }
+        return *this;
+    }
+
+    /// Destructor forgets all objects, they are not touched.
+    ~IntrusiveRbTree() = default;
+
+public:
+    /// Size returns current number of linked objects.
+    size_type Size() const noexcept { return m_size; }
+
+    /// Empty returns true if size of container is 0, false otherwise.
+    bool Empty() const noexcept { return m_size == 0; }
+
+    /// Clear forgets all objects in O(1), their hooks are left as they are.
+    void Clear() noexcept {
+        m_endNode.m_pParent = nullptr;
+        m_endNode.m_child[internal::kLeft] = nullptr;
+        m_endNode.m_child[internal::kRight] = nullptr;
+        m_size = 0;
+    }
+
+    Iterator begin() noexcept { return Iterator{First()}; }
+    Iterator end() noexcept { return Iterator{&m_endNode}; }
+
+    ConstIterator begin() const noexcept { return ConstIterator{First()}; }
+    ConstIterator end() const noexcept { return ConstIterator{&m_endNode}; }
+
+public:
+    /// Insert links `object` into the tree only if there is no object with the same key. Returns
+    /// the object, which holds the key in the tree.
+    T* Insert(T& object) noexcept {
+        BasePtr pCurrNode = m_endNode.m_pParent;
+        BasePtr pParentNode = nullptr;  // this node will be a parent of the object
+        std::size_t dir = internal::kLeft;
+        const auto& key = m_keyOf(object);
+        // the last node, which is not greater than `key`, only it can hold an equal key
+        BasePtr pCandidate = nullptr;
+
+        while (pCurrNode) {
+            pParentNode = pCurrNode;
+            if constexpr (kEarlyExit) {
+                const auto order = Compare(key, KeyOfNode(pCurrNode));
+                if (order < 0) {
+                    dir = internal::kLeft;
+                } else if (order > 0) {
+                    dir = internal::kRight;
+                } else {
+                    return ObjectOf(pCurrNode);
+                }
+            } else if (Less(key, KeyOfNode(pCurrNode))) {
+                dir = internal::kLeft;
+            } else {
+                dir = internal::kRight;
+                pCandidate = pCurrNode;
+            }
+            pCurrNode = pCurrNode->m_child[dir];
+        }
+
+        if (pCandidate && !Less(KeyOfNode(pCandidate), key)) {
+            return ObjectOf(pCandidate);
+        }
+        internal::LinkNode(*this, pParentNode, dir, HookOf(object));
+        return std::addressof(object);
+    }
+
+    /// Find returns an object, which holds a `key`.
+    T* Find(const key_type& key) noexcept {
+        BasePtr pNode = FindNode(key);
+        return pNode ? ObjectOf(pNode) : nullptr;
+    }
+
+    const T* Find(const key_type& key) const noexcept {
+        BasePtr pNode = FindNode(key);
+        return pNode ? ObjectOf(pNode) : nullptr;
+    }
+
+    /// Contains retuns true if an object with `key` is linked into the tree.
+    bool Contains(const key_type& key) const noexcept { return FindNode(key) != nullptr; }
+
+    /// `Remove` unlinks an object with `key` and returns it, or `nullptr` if there is no such one.
+    T* Remove(const key_type& key) noexcept {
+        T* pObject = Find(key);
+        if (pObject) {
+            Erase(*pObject);
+        }
+        return pObject;
+    }
+
+    /// `Erase` unlinks `object`, which must be linked into this tree, without a search.
+    void Erase(T& object) noexcept { internal::UnlinkNode(*this, HookOf(object)); }
+
+private:
+    // `FindNode` returns the node of an object, which holds a `key`.
+    BasePtr FindNode(const key_type& key) const noexcept {
+        BasePtr pCurrNode = m_endNode.m_pParent;
+
+        if constexpr (kEarlyExit) {
+            while (pCurrNode) {
+                const auto order = Compare(key, KeyOfNode(pCurrNode));
+                if (order < 0) {
+                    pCurrNode = pCurrNode->m_child[internal::kLeft];
+                } else if (order > 0) {
+                    pCurrNode = pCurrNode->m_child[internal::kRight];
+                } else {
+                    return pCurrNode;
+                }
+            }
+            return nullptr;
+        } else {
+            // `pCandidate` is the last node, which is not less than `key`, it is the only one to
+            // check for equality
+            BasePtr pCandidate = nullptr;
+
+            while (pCurrNode) {
+                if (Less(KeyOfNode(pCurrNode), key)) {
+                    pCurrNode = pCurrNode->m_child[internal::kRight];
+                } else {
+                    pCandidate = pCurrNode;
+                    pCurrNode = pCurrNode->m_child[internal::kLeft];
+                }
+            }
+
+            if (pCandidate && !Less(key, KeyOfNode(pCandidate))) {
+                return pCandidate;
+            }
+            return nullptr;
+        }
+    }
+
+    // `First` returns the most left node, or the end node of an empty tree.
+    const internal::NodeBase* First() const noexcept {
+        return m_size > 0 ? m_endNode.m_child[internal::kLeft] : &m_endNode;
+    }
+
+    static BasePtr HookOf(T& object) noexcept {
+        return static_cast<HookType*>(std::addressof(object));
+    }
+
+    static T* ObjectOf(BasePtr pNode) noexcept {
+        return static_cast<T*>(static_cast<HookType*>(pNode));
+    }
+
+    decltype(auto) KeyOfNode(BasePtr pNode) const noexcept { return m_keyOf(*ObjectOf(pNode)); }
+
+    bool Less(const key_type& lhs, const key_type& rhs) const noexcept {
+        if constexpr (kThreeWayCompare) {
+            return m_compare(lhs, rhs) < 0;
+        } else {
+            return m_compare(lhs, rhs);
+        }
+    }
+
+    // `Compare` orders keys by a three-way comparator or by `<` applied twice to cheap keys, like
+    // `RbTree::Compare` does.
+    auto Compare(const key_type& lhs, const key_type& rhs) const noexcept {
+        if constexpr (kThreeWayCompare) {
+            return m_compare(lhs, rhs);
+        } else if (Less(lhs, rhs)) {
+            return std::weak_ordering::less;
+        } else if (Less(rhs, lhs)) {
+            return std::weak_ordering::greater;
+        } else {
+            return std::weak_ordering::equivalent;
+        }
+    }
+
+    void TakeFrom(IntrusiveRbTree& other) noexcept {
+        if (other.m_size == 0) {
+            return;
+        }
+        m_endNode = other.m_endNode;
+        m_endNode.m_pParent->m_pParent = &m_endNode;
+        m_size = other.m_size;
+        other.Clear();
+    }
+
+private:
+    // a descent stops at an equal key only if a comparison tells the order in one call
+    static constexpr bool kThreeWayCompare = internal::IsThreeWayCompare<compare, key_type>;
+    static constexpr bool kEarlyExit =
+        kThreeWayCompare || internal::IsCheapCompare<compare, key_type>;
+
+    [[no_unique_address]] KeyOf m_keyOf{};
+    [[no_unique_address]] compare m_compare{};
+};
+
+}  // namespace ads
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ads {
+
+/// `PerfCounter` enumerates hardware events collected around benchmark phases.
+enum class PerfCounter : std::size_t {
+    Cycles,
+    Instructions,
+    L1DMisses,
+    LLCMisses,
+    DTLBMisses,
+    BranchMisses,
+    Count,
+};
+
+inline constexpr std::size_t kPerfCounterCount = static_cast<std::size_t>(PerfCounter::Count);
+
+/// `PerfCounterNames` are used in reports, in the order of `PerfCounter`.
+inline constexpr std::array<const char*, kPerfCounterCount> kPerfCounterNames = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses",
+};
+
+/// `PerfSample` holds counted events, an event is empty when its counter is unavailable.
+using PerfSample = std::array<std::optional<double>, kPerfCounterCount>;
+
+/// `PerfCounters` counts hardware events of the calling thread with Linux `perf_event_open`. Every
+/// event has its own file descriptor, so an event the CPU or the container doesn't allow (e.g.
+/// `perf_event_paranoid` or missing PMU virtualization) is just reported as unavailable. Only
+/// user-space events are counted. Counts are scaled when the kernel multiplexes counters, an event
+/// the kernel never scheduled is unavailable too.
+class PerfCounters {
+public:
+    PerfCounters() {
+#if defined(__linux__)
+        const auto cache = [](std::uint64_t cacheId, std::uint64_t result) {
+            return cacheId | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+        };
+
+        Open(PerfCounter::Cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        Open(PerfCounter::Instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        Open(PerfCounter::L1DMisses, PERF_TYPE_HW_CACHE,
+             cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS));
+        Open(PerfCounter::LLCMisses, PERF_TYPE_HW_CACHE,
+             cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS));
+        Open(PerfCounter::DTLBMisses, PERF_TYPE_HW_CACHE,
+             cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS));
+        Open(PerfCounter::BranchMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+#if defined(__linux__)
+        for (int fd : m_fds) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+#endif
+    }
+
+    /// Available returns true if at least one counter could be opened.
+    bool Available() const noexcept {
+        for (int fd : m_fds) {
+            if (fd >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Start resets and enables all counters.
+    void Start() noexcept {
+#if defined(__linux__)
+        for (int fd : m_fds) {
+            if (fd >= 0) {
+                ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    /// Stop disables all counters and adds their values to `sample`. An event, which didn't run at
+    /// all, is left as it is.
+    void Stop(PerfSample& sample) noexcept {
+#if defined(__linux__)
+        for (std::size_t i = 0; i < kPerfCounterCount; ++i) {
+            if (m_fds[i] < 0) {
+                continue;
+            }
+            ::ioctl(m_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+            // value, time enabled, time running
+            std::uint64_t values[3] = {};
+            if (::read(m_fds[i], values, sizeof(values)) != sizeof(values)) {
+                continue;
+            }
+
+            // more events than counters, and this one never got a counter: its 0 means nothing
+            if (values[2] == 0) {
+                continue;
+            }
+
+            double count = static_cast<double>(values[0]);
+            if (values[2] < values[1]) {
+                count *= static_cast<double>(values[1]) / static_cast<double>(values[2]);
+            }
+            sample[i] = sample[i].value_or(0.0) + count;
+        }
+#else
+        (void)sample;
+#endif
+    }
+
+private:
+#if defined(__linux__)
+    void Open(PerfCounter counter, std::uint32_t type, std::uint64_t config) noexcept {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        const long fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        m_fds[static_cast<std::size_t>(counter)] = static_cast<int>(fd);
+    }
+#endif
+
+private:
+    std::array<int, kPerfCounterCount> m_fds{-1, -1, -1, -1, -1, -1};
+};
+
+}  // namespace ads
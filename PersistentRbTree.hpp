@@ -0,0 +1,617 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include "RbTree.hpp"
+
+namespace ads {
+
+namespace internal {
+
+// `OffsetPtr` is a self-relative pointer: it keeps the distance in bytes from its own address to
+// the target. A structure linked with `OffsetPtr`s stays valid wherever the memory holding it is
+// mapped, which is what makes a tree inside a file usable right after `mmap`. Offset 0 means
+// `nullptr` (a link never points at itself, see `PersistentNode`).
+template <typename T>
+class OffsetPtr {
+public:
+    OffsetPtr() noexcept = default;
+    OffsetPtr(const OffsetPtr&) = delete;  // copying bytes would break the offset
+
+    OffsetPtr& operator=(const OffsetPtr& other) noexcept { return *this = other.Get(); }
+
+    OffsetPtr& operator=(T* pTarget) noexcept {
+        m_offset = pTarget ? reinterpret_cast<std::intptr_t>(pTarget) -
+                                 reinterpret_cast<std::intptr_t>(this)
+                           : 0;
+        return *this;
+    }
+
+    T* Get() const noexcept {
+        return m_offset ? reinterpret_cast<T*>(reinterpret_cast<std::intptr_t>(this) + m_offset)
+                        : nullptr;
+    }
+
+    operator T*() const noexcept { return Get(); }
+    T* operator->() const noexcept { return Get(); }
+
+private:
+    std::int64_t m_offset = 0;
+};
+
+// `PersistentNode` mirrors `Node`, but links nodes with `OffsetPtr`. `m_color` goes first, so no
+// link field shares an address with the node it could point to.
+template <typename T>
+struct PersistentNode {
+    Color m_color;
+    OffsetPtr<PersistentNode> m_pParent;  // also links free nodes together
+    OffsetPtr<PersistentNode> m_pLeft;
+    OffsetPtr<PersistentNode> m_pRight;
+    T m_value;
+};
+
+// `PersistentHeader` is stored at the beginning of the file. Root has `nullptr` as a parent, there
+// is no end node in a persistent tree.
+template <typename T>
+struct PersistentHeader {
+    char m_magic[8];
+    std::uint64_t m_version;
+    std::uint64_t m_nodeSize;  // protects from opening a file with a different value type
+    std::uint64_t m_capacity;  // size of the file in bytes, it may be larger after a crash
+    std::uint64_t m_used;      // bytes handed out by the bump allocator
+    std::uint64_t m_size;
+    OffsetPtr<PersistentNode<T>> m_pRoot;
+    OffsetPtr<PersistentNode<T>> m_pFreeList;
+};
+
+inline constexpr char kPersistentMagic[8] = {'A', 'D', 'S', 'R', 'B', 'T', '\0', '\0'};
+inline constexpr std::uint64_t kPersistentVersion = 1;
+
+}  // namespace internal
+
+/// `PersistentRbTree` is a red-black tree which lives in a memory-mapped file. Nodes are linked
+/// with self-relative offsets, so reopening the file gives a ready-to-use tree without rebuilding
+/// it: pages are faulted in lazily by the kernel on first access.
+///
+/// Only trivially copyable keys and values can be stored. Changes reach the file eventually, but
+/// only `Sync()` guarantees they are durable. A crash in the middle of an update may leave the
+/// file inconsistent, so `Sync()` at points which have to survive a restart.
+///
+/// Node pointers returned by `Insert` and `Find` are invalidated when the file grows, i.e. by the
+/// next insertion of a new key. Inserting or updating a key which is already there never grows it.
+template <typename V, typename Cmp = std::less<typename internal::KeyValueType<V>::key_type>>
+class PersistentRbTree {
+public:
+    using key_value_type = V;
+    using key_type = typename internal::KeyValueType<V>::key_type;
+    using value_type = typename internal::KeyValueType<V>::value_type;
+    using compare = Cmp;
+    using size_type = std::size_t;
+
+    using NodeType = internal::PersistentNode<key_value_type>;
+    using NodePtr = NodeType*;
+
+    static_assert(std::is_trivially_copyable_v<key_type> &&
+                      std::is_trivially_copyable_v<value_type>,
+                  "PersistentRbTree can store only trivially copyable keys and values");
+
+public:
+    /// Opens the tree stored in `path` or creates a new one. Throws `std::system_error` if the
+    /// file can't be opened or mapped and `std::runtime_error` if it holds something else.
+    explicit PersistentRbTree(const std::string& path, size_type initialCapacity = 1 << 20) {
+        m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (m_fd < 0) {
+            ThrowSystemError("open " + path);
+        }
+
+        struct stat st {};
+        if (::fstat(m_fd, &st) != 0) {
+            CloseAndThrow("fstat " + path);
+        }
+
+        const bool isNewFile = st.st_size == 0;
+        size_type capacity = static_cast<size_type>(st.st_size);
+
+        if (isNewFile) {
+            capacity = std::max(initialCapacity, FirstNodeOffset() + sizeof(NodeType));
+            if (::ftruncate(m_fd, static_cast<off_t>(capacity)) != 0) {
+                CloseAndThrow("ftruncate " + path);
+            }
+        } else if (capacity < sizeof(HeaderType)) {
+            ::close(m_fd);
+            throw std::runtime_error(path + " is not a persistent tree");
+        }
+
+        void* pBase = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (pBase == MAP_FAILED) {
+            CloseAndThrow("mmap " + path);
+        }
+        m_pHeader = static_cast<HeaderType*>(pBase);
+
+        if (isNewFile) {
+            InitHeader(capacity);
+        } else if (std::memcmp(m_pHeader->m_magic, internal::kPersistentMagic,
+                               sizeof(internal::kPersistentMagic)) != 0 ||
+                   m_pHeader->m_version != internal::kPersistentVersion ||
+                   m_pHeader->m_nodeSize != sizeof(NodeType) ||
+                   m_pHeader->m_capacity > capacity) {
+            ::munmap(pBase, capacity);
+            ::close(m_fd);
+            throw std::runtime_error(path + " holds an incompatible persistent tree");
+        } else {
+            // `ReserveNode` grows the file before it updates the header, so a crash in between
+            // leaves a larger file with intact nodes: all of it is used from now on
+            m_pHeader->m_capacity = capacity;
+        }
+    }
+
+    PersistentRbTree(const PersistentRbTree&) = delete;
+    PersistentRbTree& operator=(const PersistentRbTree&) = delete;
+
+    PersistentRbTree(PersistentRbTree&& other) noexcept
+        : m_pHeader{other.m_pHeader}, m_fd{other.m_fd}, m_compare{std::move(other.m_compare)} {
+        other.m_pHeader = nullptr;
+        other.m_fd = -1;
+    }
+
+    PersistentRbTree& operator=(PersistentRbTree&& other) noexcept {
+        if (this != std::addressof(other)) {
+            Unmap();
+            m_pHeader = std::exchange(other.m_pHeader, nullptr);
+            m_fd = std::exchange(other.m_fd, -1);
+            m_compare = std::move(other.m_compare);
+        }
+        return *this;
+    }
+
+    /// Destructor unmaps the file. Unsynced changes are written back by the kernel later.
+    ~PersistentRbTree() { Unmap(); }
+
+public:
+    /// Size returns current number of elements in container.
+    size_type Size() const noexcept { return m_pHeader->m_size; }
+
+    /// Empty returns true if size of container is 0, false otherwise.
+    bool Empty() const noexcept { return m_pHeader->m_size == 0; }
+
+    /// Capacity returns current size of the backing file in bytes.
+    size_type Capacity() const noexcept { return m_pHeader->m_capacity; }
+
+    /// Sync flushes all changes to the file. Throws `std::system_error` on failure.
+    void Sync() {
+        if (::msync(m_pHeader, m_pHeader->m_capacity, MS_SYNC) != 0) {
+            ThrowSystemError("msync");
+        }
+    }
+
+    /// Clear removes all elements. The file keeps its size.
+    void Clear() noexcept {
+        m_pHeader->m_used = FirstNodeOffset();
+        m_pHeader->m_size = 0;
+        m_pHeader->m_pRoot = nullptr;
+        m_pHeader->m_pFreeList = nullptr;
+    }
+
+public:
+    /// Insert adds a new value to the container only if it is not presented in the tree.
+    NodePtr Insert(const key_value_type& val) { return InsertInternal(val); }
+
+    /// InsertOrUpdate adds new value to the tree or update already existing one.
+    NodePtr InsertOrUpdate(const key_value_type& val) { return InsertInternal(val, true); }
+
+    /// Find returns a node, which holds a `key`.
+    NodePtr Find(const key_type& key) const noexcept {
+        NodePtr pCurrNode = m_pHeader->m_pRoot;
+
+        while (pCurrNode) {
+            const key_type& currKey = KeyOf(pCurrNode);
+
+            if (m_compare(key, currKey)) {
+                pCurrNode = pCurrNode->m_pLeft;
+            } else if (m_compare(currKey, key)) {
+                pCurrNode = pCurrNode->m_pRight;
+            } else {
+                return pCurrNode;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /// Contains retuns true if value with `key` is presented in the tree.
+    bool Contains(const key_type& key) const noexcept { return Find(key) != nullptr; }
+
+    /// `Remove` removes element with key node and re-balance the tree if needed.
+    void Remove(const key_type& key) noexcept {
+        if (NodePtr pNode = Find(key)) {
+            EraseNode(pNode);
+        }
+    }
+
+private:
+    using HeaderType = internal::PersistentHeader<key_value_type>;
+
+    static size_type FirstNodeOffset() noexcept {
+        return (sizeof(HeaderType) + alignof(NodeType) - 1) / alignof(NodeType) *
+               alignof(NodeType);
+    }
+
+    // `OffsetOf` and `NodeAt` convert between a node and its position in the file.
+    size_type OffsetOf(NodePtr pNode) const noexcept {
+        return static_cast<size_type>(reinterpret_cast<char*>(pNode) -
+                                      reinterpret_cast<char*>(m_pHeader));
+    }
+
+    NodePtr NodeAt(size_type offset) const noexcept {
+        return reinterpret_cast<NodePtr>(reinterpret_cast<char*>(m_pHeader) + offset);
+    }
+
+    static const key_type& KeyOf(NodePtr pNode) noexcept {
+        if constexpr (std::is_same_v<key_type, key_value_type>) {
+            return pNode->m_value;
+        } else {
+            return pNode->m_value.first;
+        }
+    }
+
+    static bool IsRed(NodePtr pNode) noexcept {
+        return pNode && pNode->m_color == internal::Color::Red;
+    }
+
+    [[noreturn]] static void ThrowSystemError(const std::string& what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    [[noreturn]] void CloseAndThrow(const std::string& what) {
+        const int error = errno;
+        ::close(m_fd);
+        throw std::system_error(error, std::generic_category(), what);
+    }
+
+    void InitHeader(size_type capacity) noexcept {
+        std::memcpy(m_pHeader->m_magic, internal::kPersistentMagic,
+                    sizeof(internal::kPersistentMagic));
+        m_pHeader->m_version = internal::kPersistentVersion;
+        m_pHeader->m_nodeSize = sizeof(NodeType);
+        m_pHeader->m_capacity = capacity;
+        Clear();
+    }
+
+    void Unmap() noexcept {
+        if (m_pHeader) {
+            ::munmap(m_pHeader, m_pHeader->m_capacity);
+            m_pHeader = nullptr;
+        }
+        if (m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    // `ReserveNode` makes sure the next `AllocateNode` won't grow the file. Growing may move the
+    // mapping, so raw pointers to nodes taken before it have to be kept as offsets.
+    void ReserveNode() {
+        if (m_pHeader->m_pFreeList || m_pHeader->m_used + sizeof(NodeType) <= Capacity()) {
+            return;
+        }
+
+        const size_type oldCapacity = Capacity();
+        const size_type newCapacity = oldCapacity * 2;
+
+        if (::ftruncate(m_fd, static_cast<off_t>(newCapacity)) != 0) {
+            ThrowSystemError("ftruncate");
+        }
+
+        void* pBase = ::mremap(m_pHeader, oldCapacity, newCapacity, MREMAP_MAYMOVE);
+        if (pBase == MAP_FAILED) {
+            // the header keeps the old capacity, so the file keeps the old size as well
+            const int error = errno;
+            [[maybe_unused]] const int result = ::ftruncate(m_fd, static_cast<off_t>(oldCapacity));
+            throw std::system_error(error, std::generic_category(), "mremap");
+        }
+
+        m_pHeader = static_cast<HeaderType*>(pBase);
+        m_pHeader->m_capacity = newCapacity;
+    }
+
+    NodePtr AllocateNode(const key_value_type& val, NodePtr pParent, internal::Color color) {
+        NodePtr pNode = m_pHeader->m_pFreeList;
+
+        if (pNode) {
+            m_pHeader->m_pFreeList = pNode->m_pParent;
+        } else {
+            pNode = new (reinterpret_cast<char*>(m_pHeader) + m_pHeader->m_used) NodeType{};
+            m_pHeader->m_used += sizeof(NodeType);
+        }
+
+        pNode->m_color = color;
+        pNode->m_pParent = pParent;
+        pNode->m_pLeft = nullptr;
+        pNode->m_pRight = nullptr;
+        pNode->m_value = val;
+        return pNode;
+    }
+
+    void DeallocateNode(NodePtr pNode) noexcept {
+        pNode->m_pParent = m_pHeader->m_pFreeList;
+        m_pHeader->m_pFreeList = pNode;
+    }
+
+    // `ReplaceChild` makes `pNew` a child of `pOld`'s parent instead of `pOld`.
+    void ReplaceChild(NodePtr pOld, NodePtr pNew) noexcept {
+        NodePtr pParent = pOld->m_pParent;
+
+        if (!pParent) {
+            m_pHeader->m_pRoot = pNew;
+        } else if (pParent->m_pLeft.Get() == pOld) {
+            pParent->m_pLeft = pNew;
+        } else {
+            pParent->m_pRight = pNew;
+        }
+    }
+
+    void LeftRotate(NodePtr pRotationNode) noexcept {
+        NodePtr pSubtree = pRotationNode->m_pRight;
+        pRotationNode->m_pRight = pSubtree->m_pLeft;
+
+        if (pSubtree->m_pLeft) {
+            pSubtree->m_pLeft->m_pParent = pRotationNode;
+        }
+
+        ReplaceChild(pRotationNode, pSubtree);
+        pSubtree->m_pParent = pRotationNode->m_pParent;
+        pSubtree->m_pLeft = pRotationNode;
+        pRotationNode->m_pParent = pSubtree;
+    }
+
+    void RightRotate(NodePtr pRotationNode) noexcept {
+        NodePtr pSubtree = pRotationNode->m_pLeft;
+        pRotationNode->m_pLeft = pSubtree->m_pRight;
+
+        if (pSubtree->m_pRight) {
+            pSubtree->m_pRight->m_pParent = pRotationNode;
+        }
+
+        ReplaceChild(pRotationNode, pSubtree);
+        pSubtree->m_pParent = pRotationNode->m_pParent;
+        pSubtree->m_pRight = pRotationNode;
+        pRotationNode->m_pParent = pSubtree;
+    }
+
+    NodePtr InsertInternal(const key_value_type& val, bool updateIfExists = false) {
+        NodePtr pCurrNode = m_pHeader->m_pRoot;
+        NodePtr pParentNode = nullptr;  // this node will be a parent of a new node
+
+        const key_type keyToInsert = internal::Key(val);
+        bool insertLeft = false;
+
+        while (pCurrNode) {
+            pParentNode = pCurrNode;
+            const key_type& keyCurrNode = KeyOf(pCurrNode);
+
+            if (m_compare(keyToInsert, keyCurrNode)) {
+                insertLeft = true;
+                pCurrNode = pCurrNode->m_pLeft;
+            } else if (m_compare(keyCurrNode, keyToInsert)) {
+                insertLeft = false;
+                pCurrNode = pCurrNode->m_pRight;
+            } else {
+                if (updateIfExists) {
+                    pCurrNode->m_value = val;
+                }
+                return pCurrNode;
+            }
+        }
+
+        // the key is missing, so only now the file may grow and move the parent with the mapping
+        const size_type parentOffset = pParentNode ? OffsetOf(pParentNode) : 0;
+        ReserveNode();
+        pParentNode = pParentNode ? NodeAt(parentOffset) : nullptr;
+
+        NodePtr pNewNode = AllocateNode(val, pParentNode, internal::Color::Red);
+
+        if (!pParentNode) {
+            m_pHeader->m_pRoot = pNewNode;
+        } else if (insertLeft) {
+            pParentNode->m_pLeft = pNewNode;
+        } else {
+            pParentNode->m_pRight = pNewNode;
+        }
+
+        RebalanceAfterInsert(pNewNode);
+        ++m_pHeader->m_size;
+
+        return pNewNode;
+    }
+
+    void RebalanceAfterInsert(NodePtr pCurrNode) noexcept {
+        while (IsRed(pCurrNode->m_pParent)) {
+            NodePtr pParent = pCurrNode->m_pParent;
+            NodePtr pGrandParent = pParent->m_pParent;
+
+            if (pGrandParent->m_pLeft.Get() == pParent) {
+                NodePtr pUncleNode = pGrandParent->m_pRight;
+
+                if (IsRed(pUncleNode)) {
+                    pParent->m_color = internal::Color::Black;
+                    pUncleNode->m_color = internal::Color::Black;
+                    pGrandParent->m_color = internal::Color::Red;
+                    pCurrNode = pGrandParent;
+                } else {
+                    if (pParent->m_pRight.Get() == pCurrNode) {
+                        pCurrNode = pParent;
+                        LeftRotate(pCurrNode);
+                        pParent = pCurrNode->m_pParent;
+                    }
+
+                    pParent->m_color = internal::Color::Black;
+                    pGrandParent->m_color = internal::Color::Red;
+                    RightRotate(pGrandParent);
+                }
+            } else {
+                NodePtr pUncleNode = pGrandParent->m_pLeft;
+
+                if (IsRed(pUncleNode)) {
+                    pParent->m_color = internal::Color::Black;
+                    pUncleNode->m_color = internal::Color::Black;
+                    pGrandParent->m_color = internal::Color::Red;
+                    pCurrNode = pGrandParent;
+                } else {
+                    if (pParent->m_pLeft.Get() == pCurrNode) {
+                        pCurrNode = pParent;
+                        RightRotate(pCurrNode);
+                        pParent = pCurrNode->m_pParent;
+                    }
+
+                    pParent->m_color = internal::Color::Black;
+                    pGrandParent->m_color = internal::Color::Red;
+                    LeftRotate(pGrandParent);
+                }
+            }
+        }
+
+        m_pHeader->m_pRoot->m_color = internal::Color::Black;
+    }
+
+    // `EraseNode` unlinks `pNode` from the tree and re-balance the tree if needed. Removed subtree
+    // position is tracked by `pTransplantParent`, because the transplanted node can be `nullptr`.
+    void EraseNode(NodePtr pNode) noexcept {
+        NodePtr pRemoved = pNode;  // node which is physically unlinked from its position
+        NodePtr pTransplant = nullptr;
+        NodePtr pTransplantParent = nullptr;
+
+        if (!pNode->m_pLeft) {
+            pTransplant = pNode->m_pRight;
+        } else if (!pNode->m_pRight) {
+            pTransplant = pNode->m_pLeft;
+        } else {
+            pRemoved = pNode->m_pRight;
+            while (pRemoved->m_pLeft) {
+                pRemoved = pRemoved->m_pLeft;
+            }
+            pTransplant = pRemoved->m_pRight;
+        }
+
+        if (pRemoved != pNode) {
+            // successor takes the place of `pNode`
+            pNode->m_pLeft->m_pParent = pRemoved;
+            pRemoved->m_pLeft = pNode->m_pLeft;
+
+            if (pRemoved != pNode->m_pRight.Get()) {
+                pTransplantParent = pRemoved->m_pParent;
+                if (pTransplant) {
+                    pTransplant->m_pParent = pTransplantParent;
+                }
+                pTransplantParent->m_pLeft = pTransplant;
+                pRemoved->m_pRight = pNode->m_pRight;
+                pNode->m_pRight->m_pParent = pRemoved;
+            } else {
+                pTransplantParent = pRemoved;
+            }
+
+            ReplaceChild(pNode, pRemoved);
+            pRemoved->m_pParent = pNode->m_pParent;
+            std::swap(pRemoved->m_color, pNode->m_color);
+        } else {
+            pTransplantParent = pNode->m_pParent;
+            if (pTransplant) {
+                pTransplant->m_pParent = pTransplantParent;
+            }
+            ReplaceChild(pNode, pTransplant);
+        }
+
+        if (pNode->m_color == internal::Color::Black) {
+            RebalanceAfterRemove(pTransplant, pTransplantParent);
+        }
+
+        DeallocateNode(pNode);
+        --m_pHeader->m_size;
+    }
+
+    void RebalanceAfterRemove(NodePtr pCurrNode, NodePtr pParent) noexcept {
+        while (pCurrNode != m_pHeader->m_pRoot.Get() && !IsRed(pCurrNode)) {
+            if (pCurrNode == pParent->m_pLeft.Get()) {
+                NodePtr pSibling = pParent->m_pRight;
+
+                if (IsRed(pSibling)) {
+                    pSibling->m_color = internal::Color::Black;
+                    pParent->m_color = internal::Color::Red;
+                    LeftRotate(pParent);
+                    pSibling = pParent->m_pRight;
+                }
+
+                if (!IsRed(pSibling->m_pLeft) && !IsRed(pSibling->m_pRight)) {
+                    pSibling->m_color = internal::Color::Red;
+                    pCurrNode = pParent;
+                    pParent = pParent->m_pParent;
+                } else {
+                    if (!IsRed(pSibling->m_pRight)) {
+                        pSibling->m_pLeft->m_color = internal::Color::Black;
+                        pSibling->m_color = internal::Color::Red;
+                        RightRotate(pSibling);
+                        pSibling = pParent->m_pRight;
+                    }
+
+                    pSibling->m_color = pParent->m_color;
+                    pParent->m_color = internal::Color::Black;
+                    pSibling->m_pRight->m_color = internal::Color::Black;
+                    LeftRotate(pParent);
+                    break;
+                }
+            } else {
+                NodePtr pSibling = pParent->m_pLeft;
+
+                if (IsRed(pSibling)) {
+                    pSibling->m_color = internal::Color::Black;
+                    pParent->m_color = internal::Color::Red;
+                    RightRotate(pParent);
+                    pSibling = pParent->m_pLeft;
+                }
+
+                if (!IsRed(pSibling->m_pLeft) && !IsRed(pSibling->m_pRight)) {
+                    pSibling->m_color = internal::Color::Red;
+                    pCurrNode = pParent;
+                    pParent = pParent->m_pParent;
+                } else {
+                    if (!IsRed(pSibling->m_pLeft)) {
+                        pSibling->m_pRight->m_color = internal::Color::Black;
+                        pSibling->m_color = internal::Color::Red;
+                        LeftRotate(pSibling);
+                        pSibling = pParent->m_pLeft;
+                    }
+
+                    pSibling->m_color = pParent->m_color;
+                    pParent->m_color = internal::Color::Black;
+                    pSibling->m_pLeft->m_color = internal::Color::Black;
+                    RightRotate(pParent);
+                    break;
+                }
+            }
+        }
+
+        if (pCurrNode) {
+            pCurrNode->m_color = internal::Color::Black;
+        }
+    }
+
+private:
+    HeaderType* m_pHeader = nullptr;
+    int m_fd = -1;
+    compare m_compare{};
+};
+
+}  // namespace ads
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+
+#include "RbTree.hpp"
+
+namespace ads {
+
+/// `RbMultiTree` is a multiset built on `RbTree`. It keeps one node per distinct key together with
+/// a number of its occurrences, so repeated keys cost no memory at all. This suits histogram-like
+/// data, where a few keys repeat millions of times.
+template <typename K, typename Cmp = std::less<K>, typename StatsPolicy = NoStats>
+class RbMultiTree {
+public:
+    using key_type = K;
+    using compare = Cmp;
+    using size_type = std::size_t;
+
+    /// `Entry` is a distinct key and a number of its occurrences.
+    using Entry = std::pair<K, size_type>;
+    using TreeType = RbTree<Entry, Cmp, StatsPolicy>;
+    using EntryIterator = typename TreeType::ConstIterator;
+
+    /// `ConstIterator` walks keys in the ascending order, every key is repeated as many times as
+    /// it was inserted.
+    class ConstIterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = K;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const K*;
+        using reference = const K&;
+
+        ConstIterator() noexcept = default;
+
+        reference operator*() const noexcept { return m_entry->first; }
+        pointer operator->() const noexcept { return &m_entry->first; }
+
+        ConstIterator& operator++() noexcept {
+            if (++m_index == m_entry->second) {
+                ++m_entry;
+                m_index = 0;
+            }
+            return *this;
+        }
+
+        ConstIterator operator++(int) noexcept {
+            ConstIterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        ConstIterator& operator--() noexcept {
+            if (m_index == 0) {
+                --m_entry;
+                m_index = m_entry->second;
+            }
+            --m_index;
+            return *this;
+        }
+
+        ConstIterator operator--(int) noexcept {
+            ConstIterator copy = *this;
+            --*this;
+            return copy;
+        }
+
+        bool operator==(const ConstIterator& other) const noexcept {
+            return m_entry == other.m_entry && m_index == other.m_index;
+        }
+        bool operator!=(const ConstIterator& other) const noexcept { return !(*this == other); }
+
+    private:
+        friend class RbMultiTree;
+
+        explicit ConstIterator(EntryIterator entry) noexcept : m_entry{entry} {}
+
+    private:
+        EntryIterator m_entry;
+        size_type m_index = 0;  // occurrence of the current key
+    };
+
+    /// `EntryRange` exposes (key, count) pairs of a tree to a range-based for loop.
+    class EntryRange {
+    public:
+        EntryIterator begin() const noexcept { return m_tree.begin(); }
+        EntryIterator end() const noexcept { return m_tree.end(); }
+
+    private:
+        friend class RbMultiTree;
+
+        explicit EntryRange(const TreeType& tree) noexcept : m_tree{tree} {}
+
+    private:
+        const TreeType& m_tree;
+    };
+
+public:
+    /// Size returns a total number of keys, all occurrences are counted.
+    size_type Size() const noexcept { return m_size; }
+
+    /// DistinctSize returns a number of distinct keys, i.e. a number of nodes.
+    size_type DistinctSize() const noexcept { return m_tree.Size(); }
+
+    /// Empty returns true if size of container is 0, false otherwise.
+    bool Empty() const noexcept { return m_size == 0; }
+
+    /// Clear removes all keys from the container.
+    void Clear() noexcept {
+        m_tree.Clear();
+        m_size = 0;
+    }
+
+    ConstIterator begin() const noexcept { return ConstIterator{m_tree.begin()}; }
+    ConstIterator end() const noexcept { return ConstIterator{m_tree.end()}; }
+
+    /// Entries returns a range of (key, count) pairs in the ascending order of keys.
+    EntryRange Entries() const noexcept { return EntryRange{m_tree}; }
+
+public:
+    /// Insert adds one occurrence of `key`.
+    void Insert(const key_type& key) { InsertN(key, 1); }
+
+    /// InsertN adds `n` occurrences of `key` with one descent: a new node starts with count `n`,
+    /// an existing one just grows its count.
+    void InsertN(const key_type& key, size_type n) {
+        if (n == 0) {
+            return;
+        }
+        const size_type distinct = m_tree.Size();
+        auto pNode = m_tree.Insert(Entry{key, n});
+        if (m_tree.Size() == distinct) {
+            pNode->m_value.second += n;
+        }
+        m_size += n;
+    }
+
+    /// Count returns a number of occurrences of `key`.
+    size_type Count(const key_type& key) const noexcept {
+        const auto pNode = m_tree.Find(key);
+        return pNode ? pNode->m_value.second : 0;
+    }
+
+    /// Contains returns true if there is at least one occurrence of `key`.
+    bool Contains(const key_type& key) const noexcept { return m_tree.Find(key) != nullptr; }
+
+    /// RemoveOne removes one occurrence of `key`, the node goes away with the last one. Returns
+    /// false if there is no such key.
+    bool RemoveOne(const key_type& key) {
+        auto pNode = m_tree.Find(key);
+        if (!pNode) {
+            return false;
+        }
+        if (--pNode->m_value.second == 0) {
+            m_tree.Erase(pNode);
+        }
+        --m_size;
+        return true;
+    }
+
+    /// RemoveAll removes all occurrences of `key` and returns their number.
+    size_type RemoveAll(const key_type& key) {
+        auto pNode = m_tree.Find(key);
+        if (!pNode) {
+            return 0;
+        }
+        const size_type count = pNode->m_value.second;
+        m_tree.Erase(pNode);
+        m_size -= count;
+        return count;
+    }
+
+private:
+    TreeType m_tree;
+    size_type m_size = 0;  // total number of occurrences
+};
+
+}  // namespace ads
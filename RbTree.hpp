@@ -1,588 +1,2354 @@
-#pragma once
-
-#include <algorithm>
-#include <iostream>
-#include <memory>
-#include <vector>
-
-namespace ads {
-
-namespace internal {
-
-enum class Color { Red = false, Black = true };
-
-struct NodeBase {
-    Color m_color;  // we need color to make a process of rebalancing easier
-    NodeBase* m_pParent;
-    NodeBase* m_pLeft;
-    NodeBase* m_pRight;
-};
-
-template <typename T>
-struct Node : public NodeBase {
-    T m_value;
-};
-
-// TreeHeader contains information about the most left node, the most right node, root node and end
-// node. Also it contains current size of container.
-struct TreeHeader {
-    // `m_endNode` is a special node, which holds pointers to the most left node as its left child,
-    // most right node as its right child and a pointer to the root as its parent. Also `m_endNode`
-    // is a parent of a root node of tree.
-    NodeBase* m_endNode;
-
-    std::size_t m_size;
-};
-
-// `IsLeftChild` checks whether node is left child or not.
-inline bool IsLeftChild(const NodeBase* pNode) noexcept {
-    return pNode->m_pParent->m_pLeft == pNode;
-}
-
-// `IsRightChild` checks whether node is right child or not.
-inline bool IsRightChild(const NodeBase* pNode) noexcept {
-    return pNode->m_pParent->m_pRight == pNode;
-}
-
-// `TreeMax` returns the most right node of a tree. Precondition: `pNode` should not be equal
-// `nullptr`
-inline NodeBase* TreeMax(NodeBase* pNode) {
-    while (pNode->m_pRight) {
-        pNode = pNode->m_pRight;
-    }
-    return pNode;
-}
-
-// Precondition: `pNode` should not be equal `nullptr` `TreeMin` returns the most left node of a
-// tree.
-inline NodeBase* TreeMin(NodeBase* pNode) {
-    while (pNode->m_pLeft) {
-        pNode = pNode->m_pLeft;
-    }
-    return pNode;
-}
-
-// TODO: add description and visualizations.
-inline void LeftRotate(TreeHeader& header, NodeBase* pRotationNode) noexcept {
-    NodeBase* pSubtree = pRotationNode->m_pRight;
-    // turn pSubtrees' left subtree into pRotationNode's right subtree
-    pRotationNode->m_pRight = pSubtree->m_pLeft;
-
-    if (pSubtree->m_pLeft) {
-        // if left subtree of pSubtree is not empty, set a parent
-        pSubtree->m_pLeft->m_pParent = pRotationNode->m_pRight;
-    }
-
-    pSubtree->m_pParent = pRotationNode->m_pParent;
-
-    if (pRotationNode->m_pParent->m_pParent == pRotationNode) {
-        // make pSubtree root node if pRotationNode was the root
-        header.m_endNode->m_pParent = pSubtree;
-    } else if (IsLeftChild(pRotationNode)) {
-        pRotationNode->m_pParent->m_pLeft = pSubtree;
-    } else {
-        pRotationNode->m_pParent->m_pRight = pSubtree;
-    }
-
-    pSubtree->m_pLeft = pRotationNode;
-    pRotationNode->m_pParent = pSubtree;
-}
-
-// TODO: add description and visualizations.
-inline void RightRotate(TreeHeader& header, NodeBase* pRotationNode) noexcept {
-    NodeBase* pSubtree = pRotationNode->m_pLeft;
-    pRotationNode->m_pLeft = pSubtree->m_pRight;
-
-    if (pSubtree->m_pRight) {
-        // if right subtree of pSubtree is not empty, set parent
-        pSubtree->m_pRight->m_pParent = pRotationNode;
-    }
-
-    pSubtree->m_pParent = pRotationNode->m_pParent;
-
-    if (pRotationNode->m_pParent->m_pParent == pRotationNode) {
-        // make pSubtree root node if pRotationNode was the root
-        header.m_endNode->m_pParent = pSubtree;
-    } else if (IsLeftChild(pRotationNode)) {
-        pRotationNode->m_pParent->m_pLeft = pSubtree;
-    } else {
-        pRotationNode->m_pParent->m_pRight = pSubtree;
-    }
-
-    pSubtree->m_pRight = pRotationNode;
-    pRotationNode->m_pParent = pSubtree;
-}
-
-inline void RebalanceAfterInsert(TreeHeader& header, NodeBase* pInsertedNode) noexcept {
-    NodeBase* pRoot = header.m_endNode->m_pParent;
-    NodeBase* pCurrNode = pInsertedNode;
-
-    while (pCurrNode != pRoot && pCurrNode->m_pParent->m_color == Color::Red) {
-        if (IsLeftChild(pCurrNode->m_pParent)) {
-            NodeBase* pUncleNode = pCurrNode->m_pParent->m_pParent->m_pRight;
-
-            if (pUncleNode && pUncleNode->m_color == Color::Red) {
-                pCurrNode->m_pParent->m_color = Color::Black;
-                pUncleNode->m_color = Color::Black;
-                pCurrNode->m_pParent->m_pParent->m_color = Color::Red;
-                pCurrNode = pCurrNode->m_pParent->m_pParent;
-            } else {
-                if (IsRightChild(pCurrNode)) {
-                    pCurrNode = pCurrNode->m_pParent;
-                    LeftRotate(header, pCurrNode);
-                }
-
-                pCurrNode->m_pParent->m_color = Color::Black;
-                pCurrNode->m_pParent->m_pParent->m_color = Color::Red;
-                RightRotate(header, pCurrNode->m_pParent->m_pParent);
-            }
-        } else {
-            NodeBase* pUncleNode = pCurrNode->m_pParent->m_pParent->m_pLeft;
-
-            if (pUncleNode && pUncleNode->m_color == Color::Red) {
-                pCurrNode->m_pParent->m_color = Color::Black;
-                pUncleNode->m_color = Color::Black;
-                pCurrNode->m_pParent->m_pParent->m_color = Color::Red;
-                pCurrNode = pCurrNode->m_pParent->m_pParent;
-            } else {
-                if (IsLeftChild(pCurrNode)) {
-                    pCurrNode = pCurrNode->m_pParent;
-                    RightRotate(header, pCurrNode);
-                }
-
-                pCurrNode->m_pParent->m_color = Color::Black;
-                pCurrNode->m_pParent->m_pParent->m_color = Color::Red;
-                LeftRotate(header, pCurrNode->m_pParent->m_pParent);
-            }
-        }
-    }
-
-    header.m_endNode->m_pParent->m_color = Color::Black;
-}
-
-inline void Transplant(TreeHeader& header, NodeBase* pNode, NodeBase* pExchangeNode) {
-    if (pNode->m_pParent == header.m_endNode) {
-        header.m_endNode->m_pParent = pExchangeNode;
-    } else if (IsLeftChild(pNode)) {
-        pNode->m_pParent->m_pLeft = pExchangeNode;
-    } else {
-        pNode->m_pParent->m_pRight = pExchangeNode;
-    }
-
-    if (pExchangeNode) {
-        pExchangeNode->m_pParent = pNode->m_pParent;
-    }
-}
-
-inline void RebalanceAfterRemove(TreeHeader& header, NodeBase* pTransplant) {
-    if (!pTransplant)
-        return;  // Avoid nullptr dereference
-
-    NodeBase*& pRoot = header.m_endNode->m_pParent;
-    NodeBase* pCurrNode = pTransplant;
-
-    while (pCurrNode != pRoot && pCurrNode && pCurrNode->m_color == Color::Black) {
-        if (!pCurrNode->m_pParent)
-            break;  // Prevent nullptr access
-
-        if (IsLeftChild(pCurrNode)) {
-            NodeBase* pSibling = pCurrNode->m_pParent->m_pRight;
-            if (!pSibling)
-                break;
-
-            if (pSibling->m_color == Color::Red) {
-                pSibling->m_color = Color::Black;
-                pCurrNode->m_pParent->m_color = Color::Red;
-                LeftRotate(header, pCurrNode->m_pParent);
-                pSibling = pCurrNode->m_pParent->m_pRight;  // Update sibling reference
-                if (!pSibling)
-                    break;
-            }
-
-            if ((!pSibling->m_pLeft || pSibling->m_pLeft->m_color == Color::Black) &&
-                (!pSibling->m_pRight || pSibling->m_pRight->m_color == Color::Black)) {
-                pSibling->m_color = Color::Red;
-                pCurrNode = pCurrNode->m_pParent;
-            } else {
-                if (!pSibling->m_pRight || pSibling->m_pRight->m_color == Color::Black) {
-                    if (pSibling->m_pLeft)
-                        pSibling->m_pLeft->m_color = Color::Black;
-                    pSibling->m_color = Color::Red;
-                    RightRotate(header, pSibling);
-                    pSibling = pCurrNode->m_pParent->m_pRight;
-                    if (!pSibling)
-                        break;
-                }
-                pSibling->m_color = pCurrNode->m_pParent->m_color;
-                pCurrNode->m_pParent->m_color = Color::Black;
-                if (pSibling->m_pRight)
-                    pSibling->m_pRight->m_color = Color::Black;
-                LeftRotate(header, pCurrNode->m_pParent);
-                pCurrNode = pRoot;
-            }
-        } else {
-            NodeBase* pSibling = pCurrNode->m_pParent->m_pLeft;
-            if (!pSibling)
-                break;
-
-            if (pSibling->m_color == Color::Red) {
-                pSibling->m_color = Color::Black;
-                pCurrNode->m_pParent->m_color = Color::Red;
-                RightRotate(header, pCurrNode->m_pParent);
-                pSibling = pCurrNode->m_pParent->m_pLeft;
-                if (!pSibling)
-                    break;
-            }
-
-            if ((!pSibling->m_pLeft || pSibling->m_pLeft->m_color == Color::Black) &&
-                (!pSibling->m_pRight || pSibling->m_pRight->m_color == Color::Black)) {
-                pSibling->m_color = Color::Red;
-                pCurrNode = pCurrNode->m_pParent;
-            } else {
-                if (!pSibling->m_pLeft || pSibling->m_pLeft->m_color == Color::Black) {
-                    if (pSibling->m_pRight)
-                        pSibling->m_pRight->m_color = Color::Black;
-                    pSibling->m_color = Color::Red;
-                    LeftRotate(header, pSibling);
-                    pSibling = pCurrNode->m_pParent->m_pLeft;
-                    if (!pSibling)
-                        break;
-                }
-                pSibling->m_color = pCurrNode->m_pParent->m_color;
-                pCurrNode->m_pParent->m_color = Color::Black;
-                if (pSibling->m_pLeft)
-                    pSibling->m_pLeft->m_color = Color::Black;
-                RightRotate(header, pCurrNode->m_pParent);
-                pCurrNode = pRoot;
-            }
-        }
-    }
-
-    if (pCurrNode)
-        pCurrNode->m_color = Color::Black;
-}
-
-/// `KeyValueType` helps to get a `key_type` and a `value_type` from some generic type `T`.
-template <typename T>
-struct KeyValueType {
-    using key_type = T;
-    using value_type = T;
-};
-
-template <typename T1, typename T2>
-struct KeyValueType<std::pair<T1, T2>> {
-    using key_type = T1;
-    using value_type = T2;
-};
-
-template <typename T1, typename T2>
-struct KeyValueType<const std::pair<T1, T2>> {
-    using key_type = T1;
-    using value_type = T2;
-};
-
-template <typename T>
-inline T Key(const T& val) {
-    return val;
-}
-
-template <typename T1, typename T2>
-inline T1 Key(const std::pair<T1, T2>& val) {
-    return val.first;
-}
-
-template <typename T>
-inline T Value(const T& val) {
-    return val;
-}
-
-template <typename T1, typename T2>
-inline T1 Value(const std::pair<T1, T2>& val) {
-    return val.second;
-}
-
-};  // namespace internal
-
-template <typename V, typename Cmp = std::less<V>>
-class RbTree : private internal::TreeHeader {
-public:
-    using key_value_type = V;
-    using key_type = typename internal::KeyValueType<V>::key_type;
-    using value_type = typename internal::KeyValueType<V>::value_type;
-    using compare = Cmp;
-    using size_type = std::size_t;
-
-    using NodeType = internal::Node<key_value_type>;
-    using NodePtr = internal::Node<key_value_type>*;
-    using BaseType = internal::NodeBase;
-    using BasePtr = internal::NodeBase*;
-
-public:
-    // Default constructor.
-    RbTree() {
-        m_endNode = new BaseType{};
-        m_endNode->m_color = internal::Color::Red;
-        m_endNode->m_pParent = nullptr;
-        m_endNode->m_pLeft = nullptr;
-        m_endNode->m_pRight = nullptr;
-        m_compare = compare{};
-        m_size = 0;
-    }
-
-    /// Copy constructor.
-    RbTree(const RbTree& other) {}
-    /// Move constructor.
-    RbTree(RbTree&& other) {}
-
-    /// Copy assignment operator.
-    RbTree& operator=(const RbTree& other) {}
-    /// Move assignment operator.
-    RbTree& operator=(RbTree&& other) {}
-
-    /// Destructor removes all nodes of a tree.
-    ~RbTree() {}
-
-public:
-    /// Size returns current number of elements in container.
-    size_type Size() const noexcept { return m_size; }
-
-    /// Empty returns true if size of container is 0, false otherwise.
-    bool Empty() const noexcept { return m_size == 0; }
-
-public:
-    /// Insert adds a new value to the container only if it is not presented in the tree.
-    NodePtr Insert(const key_value_type& val) noexcept { return InsertInternal(val); }
-
-    /// InsertOrUpdate adds new value to the tree or update already existing one.
-    NodePtr InsertOrUpdate(const key_value_type& val) noexcept { return InsertInternal(val, true); }
-
-    /// Find returns a node, which holds a `key`.
-    NodePtr Find(const key_type& key) const noexcept {
-        NodePtr pCurrNode = Root();
-
-        while (pCurrNode) {
-            key_type currKey = internal::Key(pCurrNode->m_value);
-
-            if (m_compare(key, currKey)) {
-                pCurrNode = Left(pCurrNode);
-            } else if (m_compare(currKey, key)) {
-                pCurrNode = Right(pCurrNode);
-            } else {
-                return pCurrNode;
-            }
-        }
-
-        return nullptr;
-    }
-
-    /// Contains retuns true if value with `key` is presented in the tree.
-    bool Contains(const key_type& key) const noexcept { return Find(key) != nullptr; }
-
-    /// `Remove` removes element with key node and re-balance the tree if needed.
-    void Remove(const key_type& key) {
-        NodePtr pNodeToRemove = Find(key);
-
-        if (!pNodeToRemove) {
-            return;
-        }
-
-        // TODO: this is bad, situation with tree of size 1 should be handled more generic
-        if (m_size == 1) {
-            DeallocateNode(static_cast<NodePtr>(m_endNode->m_pParent));
-            m_endNode->m_pParent = nullptr;
-            --m_size;
-            return;
-        }
-
-        // Try to handle a situation then node to remove has no children
-        // //////////////////////////////////
-        if (!pNodeToRemove->m_pLeft && !pNodeToRemove->m_pRight) {
-            if (internal::IsLeftChild(pNodeToRemove)) {
-                pNodeToRemove->m_pParent->m_pLeft = nullptr;
-            } else {
-                pNodeToRemove->m_pParent->m_pRight = nullptr;
-            }
-            DeallocateNode(pNodeToRemove);
-            --m_size;
-            return;
-        }
-        ///////////////////////////////////////////////////////////////////////////////////////////////////
-
-        NodePtr pNode = pNodeToRemove;
-        auto nodeOriginalColor = pNodeToRemove->m_color;
-
-        NodePtr pTransplant = nullptr;
-
-        if (pNode->m_pLeft == nullptr) {
-            pTransplant = Right(pNode);
-            internal::Transplant(*this, pNode, pNode->m_pRight);
-        } else if (pNode->m_pRight == nullptr) {
-            pTransplant = Left(pNode);
-            internal::Transplant(*this, pNode, pNode->m_pLeft);
-        } else {
-            pNode = static_cast<NodePtr>(internal::TreeMin(pNode->m_pRight));
-            nodeOriginalColor = pNode->m_color;
-            // NOTE: changed it to conditional stmt, because if pNode has no children, pTransplant
-            // will be nullptr
-            pTransplant = pNode->m_pRight ? Right(pNode) : pNode;
-
-            if (pNode != Right(pNodeToRemove)) {
-                internal::Transplant(*this, pNode, pNode->m_pRight);
-                pNode->m_pRight = pNodeToRemove->m_pRight;
-                pNode->m_pRight->m_pParent = pNode;
-            } else {
-                pTransplant->m_pParent = pNode;
-            }
-
-            internal::Transplant(*this, pNodeToRemove, pNode);
-            pNode->m_pLeft = pNodeToRemove->m_pLeft;
-            pNode->m_pLeft->m_pParent = pNode;
-            pNode->m_color = pNodeToRemove->m_color;
-        }
-
-        DeallocateNode(pNodeToRemove);
-
-        --m_size;
-
-        if (nodeOriginalColor == internal::Color::Black) {
-            internal::RebalanceAfterRemove(*this, pTransplant);
-        }
-    }
-
-    bool operator==(const RbTree& other) const noexcept {
-        if (this == std::addressof(other)) {
-            return true;
-        }
-        return TreesAreEqual(Root(), other.Root());
-    }
-
-    bool operator!=(const RbTree& other) const noexcept { return !(*this == other); }
-
-    void Dump() const { Print(std::cout, Root(), 0, false); }
-
-private:
-    void Print(std::ostream& out, NodePtr pNode, size_type level, bool isLeftChild) const {
-        if (!pNode) {
-            out << "{ }\n";
-            return;
-        }
-        if (level > 0) {
-            for (size_type i = 0; i < level - 1; ++i) {
-                out << "|   ";
-            }
-            out << "|---";
-        }
-
-        out << "{ " << pNode->m_value;
-        if (level > 0) {
-            out << ", " << (isLeftChild ? "Left, " : "Right, ");
-        } else {
-            out << ", Root, ";
-        }
-        out << (pNode->m_color == internal::Color::Black ? "Black }\n" : "Red }\n");
-
-        if (pNode->m_pLeft) {
-            Print(out, Left(pNode), level + 1, true);
-        }
-        if (pNode->m_pRight) {
-            Print(out, Right(pNode), level + 1, false);
-        }
-    }
-
-    NodePtr Root() const noexcept { return static_cast<NodePtr>(m_endNode->m_pParent); }
-
-    NodePtr InsertInternal(const key_value_type& val, bool updateIfExists = false) noexcept {
-        NodePtr pCurrNode = Root();
-        NodePtr pParentNode = nullptr;  // this node will be a parent of a new node
-
-        key_type keyToInsert = internal::Key(val);
-        bool insertLeft = false;
-
-        while (pCurrNode != nullptr) {
-            pParentNode = pCurrNode;
-            key_type keyCurrNode = internal::Key(pCurrNode->m_value);
-
-            if (m_compare(keyToInsert, keyCurrNode)) {
-                insertLeft = true;
-                pCurrNode = Left(pCurrNode);
-            } else {
-                insertLeft = false;
-                if (!m_compare(keyCurrNode, keyToInsert)) {
-                    if (updateIfExists) {
-                        pCurrNode->m_value = val;
-                    }
-                    return pCurrNode;
-                }
-
-                pCurrNode = Right(pCurrNode);
-            }
-        }
-
-        NodePtr pNewNode = nullptr;
-
-        if (pParentNode == nullptr) {
-            // tree is empty, we need to create a root node
-            pNewNode = AllocateNode(val, pParentNode, internal::Color::Black);
-            m_endNode->m_pParent = pNewNode;
-            m_endNode->m_pParent->m_pParent = m_endNode;
-            m_endNode->m_pLeft = pNewNode;   // root node is now the most left
-            m_endNode->m_pRight = pNewNode;  // and the most right node
-        } else {
-            pNewNode = AllocateNode(val, pParentNode);
-
-            if (insertLeft) {
-                pParentNode->m_pLeft = pNewNode;
-                if (pParentNode == m_endNode->m_pLeft) {
-                    m_endNode->m_pLeft = pNewNode;
-                }
-            } else {
-                pParentNode->m_pRight = pNewNode;
-                if (pParentNode == m_endNode->m_pRight) {
-                    m_endNode->m_pRight = pNewNode;
-                }
-            }
-        }
-
-        internal::RebalanceAfterInsert(*this, pNewNode);
-
-        ++m_size;
-
-        return pNewNode;
-    }
-
-private:
-    NodePtr AllocateNode(const key_value_type& val,
-                         BasePtr pParent,
-                         internal::Color color = internal::Color::Red) {
-        NodePtr pNode = new NodeType{};
-        pNode->m_color = color;
-        pNode->m_pParent = pParent;
-        pNode->m_value = val;
-        return pNode;
-    }
-
-    static void DeallocateNode(NodePtr pNode) { delete pNode; }
-
-    static NodePtr Left(BasePtr pNode) { return static_cast<NodePtr>(pNode->m_pLeft); }
-
-    static NodePtr Right(BasePtr pNode) { return static_cast<NodePtr>(pNode->m_pRight); }
-
-    static bool TreesAreEqual(const NodePtr lhs, const NodePtr rhs) {
-        if (!lhs && !rhs) {
-            return true;
-        }
-        if ((lhs && !rhs) || (!lhs && rhs)) {
-            return false;
-        }
-        if (lhs->m_value != rhs->m_value || lhs->m_color != rhs->m_color) {
-            return false;
-        }
-        return NodesAreEqual(lhs->m_pLeft, rhs->m_pLeft) &&
-               NodesAreEqual(lhs->m_pRight, rhs->m_pRight);
-    }
-
-private:
-    compare m_compare;  // compare function / functor
-};
-
-}  // namespace ads
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include "Serialization.hpp"
+
+namespace ads {
+
+/// `TreeStatsSnapshot` holds the amount of work done by trees with a `TreeStats` policy.
+struct TreeStatsSnapshot {
+    /// Depths above the last bucket are counted in the last bucket.
+    static constexpr std::size_t kMaxDepth = 64;
+
+    std::uint64_t m_rotations = 0;
+    std::uint64_t m_recolors = 0;
+    std::uint64_t m_comparisons = 0;
+    std::array<std::uint64_t, kMaxDepth> m_findDepth{};    // number of `Find` calls per depth
+    std::array<std::uint64_t, kMaxDepth> m_insertDepth{};  // number of insertions per depth
+};
+
+/// `NoStats` is the default statistics policy of `RbTree`: all hooks are empty and compile away.
+struct NoStats {
+    static constexpr bool kEnabled = false;
+
+    static constexpr void OnRotate() noexcept {}
+    static constexpr void OnRecolor() noexcept {}
+    static constexpr void OnCompare() noexcept {}
+    static constexpr void OnFind(std::size_t) noexcept {}
+    static constexpr void OnInsert(std::size_t) noexcept {}
+
+    static TreeStatsSnapshot Snapshot() noexcept { return {}; }
+    static void Reset() noexcept {}
+};
+
+/// `TreeStats` is a statistics policy, which counts rotations, recolorings, comparator calls and
+/// descent depths of `Find` and insertions. Counters are thread-local, so counting costs a few
+/// plain increments, and a snapshot shows the work of the calling thread. All trees with the same
+/// `Tag` share counters, use different tags to tell trees apart.
+template <typename Tag = void>
+struct TreeStats {
+    static constexpr bool kEnabled = true;
+
+    static void OnRotate() noexcept { ++Counters().m_rotations; }
+    static void OnRecolor() noexcept { ++Counters().m_recolors; }
+    static void OnCompare() noexcept { ++Counters().m_comparisons; }
+    static void OnFind(std::size_t depth) noexcept { ++Counters().m_findDepth[Bucket(depth)]; }
+    static void OnInsert(std::size_t depth) noexcept { ++Counters().m_insertDepth[Bucket(depth)]; }
+
+    static TreeStatsSnapshot Snapshot() noexcept { return Counters(); }
+    static void Reset() noexcept { Counters() = TreeStatsSnapshot{}; }
+
+private:
+    static TreeStatsSnapshot& Counters() noexcept {
+        thread_local TreeStatsSnapshot counters{};
+        return counters;
+    }
+
+    static std::size_t Bucket(std::size_t depth) noexcept {
+        return std::min(depth, TreeStatsSnapshot::kMaxDepth - 1);
+    }
+};
+
+/// `TreeMemoryUsage` is a breakdown of memory owned by a tree, see `RbTree::MemoryUsage`.
+struct TreeMemoryUsage {
+    std::size_t m_nodeCount = 0;      // all nodes, tombstones of `LazyRemove` included
+    std::size_t m_heapNodeCount = 0;  // nodes, which live neither in inline slots nor in an arena
+    std::size_t m_nodeSize = 0;       // bytes of one node
+    std::size_t m_linkSize = 0;       // bytes of links, threads, color and a key prefix in a node
+    std::size_t m_paddingSize = 0;    // bytes of a node, which hold neither links nor the value
+    std::size_t m_sentinelSize = 0;   // bytes of the end node in the tree object
+    std::size_t m_treeBytes = 0;      // the tree object: the end node, size and inline slots
+    std::size_t m_heapNodeBytes = 0;  // nodes allocated on the heap
+    std::size_t m_slackBytes = 0;     // estimated allocator headers and rounding of heap nodes
+    std::size_t m_arenaBytes = 0;     // the block of nodes relocated by `Compact`, maybe shared
+    std::size_t m_ownedBytes = 0;     // heap memory owned by keys and values, reported by a hook
+
+    /// Total returns all bytes of the tree.
+    std::size_t Total() const noexcept {
+        return m_treeBytes + m_heapNodeBytes + m_slackBytes + m_arenaBytes + m_ownedBytes;
+    }
+};
+
+/// `EagerRemove` is the default removal policy of `RbTree`: `Remove` unlinks a node and rebalances
+/// the tree right away.
+struct EagerRemove {
+    static constexpr bool kLazy = false;
+    static constexpr std::size_t kMaxDeadPercent = 0;
+};
+
+/// `LazyRemove` is a removal policy, which turns `Remove` into a search marking a node dead: no
+/// relinking and no rotations on the write path. Lookups and iteration skip dead nodes, inserting
+/// a dead key revives its node. Once dead nodes make more than `MaxDeadPercent` percent of all
+/// nodes, `Compact` rebuilds the tree from live ones in O(n), so a removal is amortized O(log n).
+/// The rebuild is a pause proportional to the size; with `MaxDeadPercent` of 100 it never happens
+/// on its own and `Compact` can be called when the tree is idle.
+template <std::size_t MaxDeadPercent = 50>
+struct LazyRemove {
+    static_assert(MaxDeadPercent > 0 && MaxDeadPercent <= 100, "the threshold is a percentage");
+
+    static constexpr bool kLazy = true;
+    static constexpr std::size_t kMaxDeadPercent = MaxDeadPercent;
+};
+
+/// `NodeOrder` is the order, in which `RbTree::Compact` places relocated nodes in memory.
+/// `BreadthFirst` puts levels one after another: the top levels, which every descent reads, share
+/// a few cache lines and pages. `VanEmdeBoas` splits the tree into subtrees of half the height
+/// recursively and stores each of them contiguously, so a descent touches O(log_B n) blocks of any
+/// size B at once: cache lines, pages and huge pages.
+enum class NodeOrder { BreadthFirst, VanEmdeBoas };
+
+/// `HeapNodes` is the default placement policy of `RbTree`: every node is a heap allocation of its
+/// own, and the tree keeps no state for other placements.
+struct HeapNodes {
+    static constexpr bool kRelocatable = false;
+};
+
+/// `RelocatableNodes` is a placement policy, which enables `Compact(NodeOrder)`. The tree holds a
+/// reference to the block of relocated nodes, and freeing a node checks whether it lives there.
+struct RelocatableNodes {
+    static constexpr bool kRelocatable = true;
+};
+
+/// `ParentSteps` is the default iteration policy of `RbTree`: an iterator reaches the next node
+/// through child and parent links. A step is amortized O(1), but a single one climbs or descends
+/// up to O(log n) levels.
+struct ParentSteps {
+    static constexpr bool kThreaded = false;
+};
+
+/// `InOrderThreads` is an iteration policy, which keeps links to the in-order predecessor and
+/// successor in every node, so each step of an iterator is a single load. Rotations don't change
+/// the order, only insertions and removals relink neighbours, in O(1). It costs two pointers per
+/// node, and rebuilding operations like `Compact` or copying relink all nodes once.
+struct InOrderThreads {
+    static constexpr bool kThreaded = true;
+};
+
+namespace internal {
+
+enum class Color { Red = false, Black = true };
+
+// Children are indexed by direction, so mirrored cases of rotations and rebalancing are the same
+// code with `dir` and `!dir` instead of two branches.
+inline constexpr std::size_t kLeft = 0;
+inline constexpr std::size_t kRight = 1;
+
+struct NodeBase {
+    Color m_color;  // we need color to make a process of rebalancing easier
+    bool m_isDead;  // a removed node kept as a tombstone by a tree with `LazyRemove`
+    NodeBase* m_pParent;
+    NodeBase* m_child[2];  // left and right children, indexed by `kLeft` and `kRight`
+};
+
+template <typename T>
+struct Node : public NodeBase {
+    T m_value;
+};
+
+// `ThreadedNode` adds links to the in-order neighbours to a node of a tree with `InOrderThreads`.
+// The first and the last nodes link to the end node.
+template <typename NodeT>
+struct ThreadedNode : public NodeT {
+    template <typename T>
+    constexpr ThreadedNode(const NodeBase& base, T&& value) : NodeT{base, std::forward<T>(value)} {}
+
+    NodeBase* m_thread[2] = {nullptr, nullptr};  // predecessor and successor, by `kLeft`, `kRight`
+};
+
+// TreeHeader contains information about the most left node, the most right node, root node and end
+// node. Also it contains current size of container.
+struct TreeHeader {
+    // `m_endNode` is a special node, which holds pointers to the most left node as its left child,
+    // most right node as its right child and a pointer to the root as its parent. Also `m_endNode`
+    // is a parent of a root node of tree. It lives in the header, so an empty tree owns no memory,
+    // but the root has to be relinked when the header moves.
+    NodeBase m_endNode{Color::Red, false, nullptr, {nullptr, nullptr}};
+
+    std::size_t m_size = 0;
+};
+
+// `DeadNodes` counts tombstones of a tree with `LazyRemove`, it is empty for `EagerRemove`.
+template <bool kLazy>
+struct DeadNodes {
+    std::size_t m_count = 0;
+};
+
+template <>
+struct DeadNodes<false> {};
+
+// `InlineNodePool` holds memory for `N` nodes inside a tree object, free slots are tracked by a
+// bit mask. `Take` returns `nullptr` when all slots are used, then nodes come from the heap.
+template <typename NodeT, std::size_t N>
+class InlineNodePool {
+    static_assert(N <= 64, "at most 64 inline nodes are supported");
+
+public:
+    InlineNodePool() noexcept = default;
+
+    InlineNodePool(const InlineNodePool&) = delete;
+    InlineNodePool& operator=(const InlineNodePool&) = delete;
+
+    void* Take() noexcept {
+        if (m_freeSlots == 0) {
+            return nullptr;
+        }
+        const std::size_t slot = static_cast<std::size_t>(std::countr_zero(m_freeSlots));
+        m_freeSlots &= m_freeSlots - 1;
+        return m_slots + slot * sizeof(NodeT);
+    }
+
+    std::size_t UsedCount() const noexcept {
+        return N - static_cast<std::size_t>(std::popcount(m_freeSlots));
+    }
+
+    // `Give` returns a slot back to the pool, it returns false if `pNode` was not taken from it.
+    bool Give(const NodeT* pNode) noexcept {
+        const std::byte* pBytes = reinterpret_cast<const std::byte*>(pNode);
+        const std::less<const std::byte*> less{};
+        if (less(pBytes, m_slots) || !less(pBytes, m_slots + sizeof(m_slots))) {
+            return false;
+        }
+        const std::size_t slot = static_cast<std::size_t>(pBytes - m_slots) / sizeof(NodeT);
+        m_freeSlots |= std::uint64_t{1} << slot;
+        return true;
+    }
+
+private:
+    alignas(NodeT) std::byte m_slots[N * sizeof(NodeT)];
+    std::uint64_t m_freeSlots = N == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << N) - 1;
+};
+
+// Without inline slots all nodes come from the heap, which constant evaluation can use too.
+template <typename NodeT>
+class InlineNodePool<NodeT, 0> {
+public:
+    constexpr void* Take() noexcept { return nullptr; }
+    constexpr bool Give(const NodeT*) noexcept { return false; }
+    std::size_t UsedCount() const noexcept { return 0; }
+};
+
+// `NodeArena` is one block of memory, which `RbTree::Compact` relocates nodes into. Nodes are
+// placed one after another and never freed one by one: the block lives until the last tree, which
+// has nodes in it, releases it. Trees share an arena after `ExtractRange`.
+class NodeArena {
+public:
+    static constexpr std::size_t kCacheLineSize = 64;
+    static constexpr std::size_t kHugePageSize = std::size_t{2} << 20;
+
+    NodeArena(std::size_t bytes, bool hugePages)
+        : m_alignment{hugePages ? kHugePageSize : kCacheLineSize},
+          m_bytes{(bytes + m_alignment - 1) / m_alignment * m_alignment},
+          m_pBlock{static_cast<std::byte*>(::operator new(m_bytes, std::align_val_t{m_alignment}))},
+          m_pEnd{m_pBlock} {
+#if defined(__linux__)
+        if (hugePages) {
+            // only a hint: without transparent huge pages the block stays on 4K pages
+            ::madvise(m_pBlock, m_bytes, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    ~NodeArena() { ::operator delete(m_pBlock, std::align_val_t{m_alignment}); }
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    void* Take(std::size_t size) noexcept { return std::exchange(m_pEnd, m_pEnd + size); }
+
+    bool Owns(const void* pNode) const noexcept {
+        const std::byte* pBytes = static_cast<const std::byte*>(pNode);
+        const std::less<const std::byte*> less{};
+        return !less(pBytes, m_pBlock) && less(pBytes, m_pEnd);
+    }
+
+    std::size_t Bytes() const noexcept { return m_bytes; }
+
+    void Retain() noexcept { m_refCount.fetch_add(1, std::memory_order_relaxed); }
+
+    // `Release` runs once per tree and arena, it is kept out of line of removal paths.
+    __attribute__((noinline)) static void Release(NodeArena* pArena) noexcept {
+        if (pArena->m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete pArena;
+        }
+    }
+
+private:
+    std::size_t m_alignment;
+    std::size_t m_bytes;
+    std::byte* m_pBlock;
+    std::byte* m_pEnd;  // the end of placed nodes
+    std::atomic<std::size_t> m_refCount{1};
+};
+
+// `ArenaNodes` counts nodes of a tree, which live in a `NodeArena`, and holds a reference to the
+// arena while there are any. A tree without relocated nodes keeps a null pointer only. It is empty
+// for `HeapNodes`.
+template <bool kRelocatable>
+class ArenaNodes {
+public:
+    constexpr ArenaNodes() noexcept = default;
+
+    ArenaNodes(NodeArena* pArena, std::size_t count) noexcept
+        : m_pArena{pArena}, m_count{count} {}
+
+    constexpr ArenaNodes(ArenaNodes&& other) noexcept
+        : m_pArena{std::exchange(other.m_pArena, nullptr)},
+          m_count{std::exchange(other.m_count, 0)} {}
+
+    constexpr ArenaNodes& operator=(ArenaNodes&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            m_pArena = std::exchange(other.m_pArena, nullptr);
+            m_count = std::exchange(other.m_count, 0);
+        }
+        return *this;
+    }
+
+    constexpr ~ArenaNodes() { Reset(); }
+
+    constexpr bool Owns(const void* pNode) const noexcept {
+        return m_pArena && m_pArena->Owns(pNode);
+    }
+
+    // `Drop` forgets a destroyed node, the arena is released together with the last one.
+    constexpr void Drop() noexcept {
+        if (--m_count == 0) {
+            Reset();
+        }
+    }
+
+    // `Share` hands `count` nodes over to `other`, which has no arena, e.g. an extracted range.
+    void Share(ArenaNodes& other, std::size_t count) noexcept {
+        if (count == 0) {
+            return;
+        }
+        m_pArena->Retain();
+        other = ArenaNodes{m_pArena, count};
+        if ((m_count -= count) == 0) {
+            Reset();
+        }
+    }
+
+    const NodeArena* Arena() const noexcept { return m_pArena; }
+    std::size_t Count() const noexcept { return m_count; }
+
+private:
+    constexpr void Reset() noexcept {
+        if (m_pArena) {
+            NodeArena::Release(std::exchange(m_pArena, nullptr));
+            m_count = 0;
+        }
+    }
+
+private:
+    NodeArena* m_pArena = nullptr;
+    std::size_t m_count = 0;
+};
+
+template <>
+class ArenaNodes<false> {
+public:
+    static constexpr bool Owns(const void*) noexcept { return false; }
+    static constexpr void Drop() noexcept {}
+    static constexpr const NodeArena* Arena() noexcept { return nullptr; }
+    static constexpr std::size_t Count() noexcept { return 0; }
+};
+
+// `AllocationSize` estimates bytes a general purpose allocator takes for a block of `size` bytes:
+// a header of one word, rounding up to the alignment of `std::max_align_t` and a minimal chunk of
+// four words, like glibc malloc does.
+inline std::size_t AllocationSize(std::size_t size) noexcept {
+    constexpr std::size_t kAlignment = alignof(std::max_align_t);
+    const std::size_t chunk = (size + sizeof(std::size_t) + kAlignment - 1) / kAlignment;
+    return std::max(chunk * kAlignment, 4 * sizeof(void*));
+}
+
+// `IsRightChild` checks whether node is right child or not.
+constexpr bool IsRightChild(const NodeBase* pNode) noexcept {
+    return pNode->m_pParent->m_child[kRight] == pNode;
+}
+
+// `ChildDir` returns the direction from the parent to `pNode`, `kLeft` or `kRight`.
+constexpr std::size_t ChildDir(const NodeBase* pNode) noexcept {
+    return IsRightChild(pNode);
+}
+
+// `TreeMax` returns the most right node of a tree. Precondition: `pNode` should not be equal
+// `nullptr`
+constexpr NodeBase* TreeMax(NodeBase* pNode) {
+    while (pNode->m_child[kRight]) {
+        pNode = pNode->m_child[kRight];
+    }
+    return pNode;
+}
+
+// Precondition: `pNode` should not be equal `nullptr` `TreeMin` returns the most left node of a
+// tree.
+constexpr NodeBase* TreeMin(NodeBase* pNode) {
+    while (pNode->m_child[kLeft]) {
+        pNode = pNode->m_child[kLeft];
+    }
+    return pNode;
+}
+
+// `Next` returns the in-order successor of `pNode` or the end node if `pNode` is the most right
+// one.
+constexpr NodeBase* Next(NodeBase* pNode) noexcept {
+    if (pNode->m_child[kRight]) {
+        return TreeMin(pNode->m_child[kRight]);
+    }
+    // climb while `pNode` is a right child, the root is the right child of nobody
+    while (pNode->m_pParent->m_pParent != pNode && IsRightChild(pNode)) {
+        pNode = pNode->m_pParent;
+    }
+    return pNode->m_pParent;
+}
+
+// `IsEndNode` checks whether `pNode` is the end node of a non-empty tree: the end node and the
+// root are parents of each other, but the root is black and the end node is red.
+constexpr bool IsEndNode(const NodeBase* pNode) noexcept {
+    return pNode->m_color == Color::Red && pNode->m_pParent &&
+           pNode->m_pParent->m_pParent == pNode;
+}
+
+// `Prev` returns the in-order predecessor of `pNode`, the most right node for the end node or the
+// end node if `pNode` is the most left one.
+constexpr NodeBase* Prev(NodeBase* pNode) noexcept {
+    if (IsEndNode(pNode)) {
+        return pNode->m_child[kRight];
+    }
+    if (pNode->m_child[kLeft]) {
+        return TreeMax(pNode->m_child[kLeft]);
+    }
+    // climb while `pNode` is a left child, the root is the left child of nobody
+    while (pNode->m_pParent->m_pParent != pNode && pNode->m_pParent->m_child[kLeft] == pNode) {
+        pNode = pNode->m_pParent;
+    }
+    return pNode->m_pParent;
+}
+
+// `SetColor` paints a node and counts the recoloring if the color changes.
+template <typename Stats>
+constexpr void SetColor(NodeBase* pNode, Color color) noexcept {
+    if constexpr (Stats::kEnabled) {
+        if (pNode->m_color != color) {
+            Stats::OnRecolor();
+        }
+    }
+    pNode->m_color = color;
+}
+
+// `NoAugment` is the default augmentation policy of a tree: nodes keep nothing but links. An
+// augmented tree keeps in every node a value computed from the node and its children, e.g. the max
+// end of intervals in the subtree. Its policy sets `kEnabled` and recomputes the value of a node
+// in `Update`, which is called for nodes whose subtree has changed, children first.
+struct NoAugment {
+    static constexpr bool kEnabled = false;
+
+    static constexpr void Update(NodeBase*) noexcept {}
+};
+
+// `UpdatePath` updates augmented values from `pNode` up to the root.
+template <typename Augment>
+constexpr void UpdatePath(TreeHeader& header, NodeBase* pNode) noexcept {
+    if constexpr (Augment::kEnabled) {
+        for (; pNode != &header.m_endNode; pNode = pNode->m_pParent) {
+            Augment::Update(pNode);
+        }
+    }
+}
+
+// `Rotate` rotates the subtree of `pRotationNode` in direction `dir`: for `kLeft` the right child
+// of `pRotationNode` takes its place, `pRotationNode` becomes its left child and gets its former
+// left subtree as the right one. `kRight` is the mirror case.
+template <typename Stats = NoStats, typename Augment = NoAugment>
+constexpr void Rotate(TreeHeader& header, NodeBase* pRotationNode, std::size_t dir) noexcept {
+    Stats::OnRotate();
+
+    NodeBase* pSubtree = pRotationNode->m_child[!dir];
+    // turn the inner subtree of pSubtree into the outer subtree of pRotationNode
+    pRotationNode->m_child[!dir] = pSubtree->m_child[dir];
+
+    if (pSubtree->m_child[dir]) {
+        pSubtree->m_child[dir]->m_pParent = pRotationNode;
+    }
+
+    pSubtree->m_pParent = pRotationNode->m_pParent;
+
+    if (pRotationNode->m_pParent->m_pParent == pRotationNode) {
+        // make pSubtree root node if pRotationNode was the root
+        header.m_endNode.m_pParent = pSubtree;
+    } else {
+        pRotationNode->m_pParent->m_child[ChildDir(pRotationNode)] = pSubtree;
+    }
+
+    pSubtree->m_child[dir] = pRotationNode;
+    pRotationNode->m_pParent = pSubtree;
+
+    if constexpr (Augment::kEnabled) {
+        Augment::Update(pRotationNode);
+        Augment::Update(pSubtree);
+    }
+}
+
+// `RebalanceAfterInsert` restores properties of the tree after a red node was linked. Returns true
+// if the red color reached the root, so the black height of the tree grew.
+template <typename Stats = NoStats, typename Augment = NoAugment>
+constexpr bool RebalanceAfterInsert(TreeHeader& header, NodeBase* pInsertedNode) noexcept {
+    NodeBase* pRoot = header.m_endNode.m_pParent;
+    NodeBase* pCurrNode = pInsertedNode;
+
+    while (pCurrNode != pRoot && pCurrNode->m_pParent->m_color == Color::Red) {
+        NodeBase* pParent = pCurrNode->m_pParent;
+        NodeBase* pGrandParent = pParent->m_pParent;
+        // the parent is red, so it is not the root and has a real grandparent
+        const std::size_t dir = ChildDir(pParent);
+        NodeBase* pUncleNode = pGrandParent->m_child[!dir];
+
+        if (pUncleNode && pUncleNode->m_color == Color::Red) {
+            SetColor<Stats>(pParent, Color::Black);
+            SetColor<Stats>(pUncleNode, Color::Black);
+            SetColor<Stats>(pGrandParent, Color::Red);
+            pCurrNode = pGrandParent;
+        } else {
+            if (pCurrNode == pParent->m_child[!dir]) {
+                // inner grandchild, turn it into the outer one
+                pCurrNode = pParent;
+                Rotate<Stats, Augment>(header, pCurrNode, dir);
+            }
+
+            SetColor<Stats>(pCurrNode->m_pParent, Color::Black);
+            SetColor<Stats>(pGrandParent, Color::Red);
+            Rotate<Stats, Augment>(header, pGrandParent, !dir);
+        }
+    }
+
+    NodeBase* pNewRoot = header.m_endNode.m_pParent;
+    const bool heightGrew = pNewRoot->m_color == Color::Red;
+    SetColor<Stats>(pNewRoot, Color::Black);
+    return heightGrew;
+}
+
+constexpr void Transplant(TreeHeader& header, NodeBase* pNode, NodeBase* pExchangeNode) {
+    if (pNode->m_pParent == &header.m_endNode) {
+        header.m_endNode.m_pParent = pExchangeNode;
+    } else {
+        pNode->m_pParent->m_child[ChildDir(pNode)] = pExchangeNode;
+    }
+
+    if (pExchangeNode) {
+        pExchangeNode->m_pParent = pNode->m_pParent;
+    }
+}
+
+// `IsBlack` checks whether node is black, `nullptr` leaves are black.
+constexpr bool IsBlack(const NodeBase* pNode) noexcept {
+    return !pNode || pNode->m_color == Color::Black;
+}
+
+// `RebalanceAfterRemove` restores properties of the tree after a black node was unlinked.
+// `pTransplant` is the node which took its place and can be `nullptr`, so its parent is passed
+// explicitly.
+template <typename Stats = NoStats, typename Augment = NoAugment>
+constexpr void RebalanceAfterRemove(TreeHeader& header,
+                                    NodeBase* pTransplant,
+                                    NodeBase* pTransplantParent) noexcept {
+    NodeBase*& pRoot = header.m_endNode.m_pParent;
+    NodeBase* pCurrNode = pTransplant;
+    NodeBase* pParent = pTransplantParent;
+
+    while (pCurrNode != pRoot && IsBlack(pCurrNode)) {
+        // `pCurrNode` can be `nullptr`, but then its sibling is not
+        const std::size_t dir = pParent->m_child[kRight] == pCurrNode;
+        NodeBase* pSibling = pParent->m_child[!dir];
+
+        if (pSibling->m_color == Color::Red) {
+            SetColor<Stats>(pSibling, Color::Black);
+            SetColor<Stats>(pParent, Color::Red);
+            Rotate<Stats, Augment>(header, pParent, dir);
+            pSibling = pParent->m_child[!dir];
+        }
+
+        if (IsBlack(pSibling->m_child[kLeft]) && IsBlack(pSibling->m_child[kRight])) {
+            SetColor<Stats>(pSibling, Color::Red);
+            pCurrNode = pParent;
+            pParent = pParent->m_pParent;
+        } else {
+            if (IsBlack(pSibling->m_child[!dir])) {
+                SetColor<Stats>(pSibling->m_child[dir], Color::Black);
+                SetColor<Stats>(pSibling, Color::Red);
+                Rotate<Stats, Augment>(header, pSibling, !dir);
+                pSibling = pParent->m_child[!dir];
+            }
+            SetColor<Stats>(pSibling, pParent->m_color);
+            SetColor<Stats>(pParent, Color::Black);
+            SetColor<Stats>(pSibling->m_child[!dir], Color::Black);
+            Rotate<Stats, Augment>(header, pParent, dir);
+            pCurrNode = pRoot;
+        }
+    }
+
+    if (pCurrNode) {
+        SetColor<Stats>(pCurrNode, Color::Black);
+    }
+}
+
+// `LinkNode` makes `pNode` the child of `pParent` in direction `dir`, or the root if `pParent` is
+// `nullptr`, and rebalances the tree. Only links and color of `pNode` are changed, so it works
+// with any node type derived from `NodeBase`.
+template <typename Stats = NoStats, typename Augment = NoAugment>
+constexpr void LinkNode(TreeHeader& header,
+                        NodeBase* pParent,
+                        std::size_t dir,
+                        NodeBase* pNode) noexcept {
+    pNode->m_color = Color::Red;
+    pNode->m_child[kLeft] = nullptr;
+    pNode->m_child[kRight] = nullptr;
+
+    if (pParent == nullptr) {
+        pNode->m_pParent = &header.m_endNode;
+        header.m_endNode.m_pParent = pNode;
+        header.m_endNode.m_child[kLeft] = pNode;   // root node is now the most left
+        header.m_endNode.m_child[kRight] = pNode;  // and the most right node
+    } else {
+        pNode->m_pParent = pParent;
+        pParent->m_child[dir] = pNode;
+        // a new child of the most left (right) node in the same direction replaces it
+        if (pParent == header.m_endNode.m_child[dir]) {
+            header.m_endNode.m_child[dir] = pNode;
+        }
+    }
+
+    UpdatePath<Augment>(header, pNode);
+    RebalanceAfterInsert<Stats, Augment>(header, pNode);
+    ++header.m_size;
+}
+
+// `UnlinkNode` removes `pNode` from the tree and rebalances it. Nodes are relinked, values never
+// move, so pointers to other nodes stay valid. `pNode` isn't deallocated.
+template <typename Stats = NoStats, typename Augment = NoAugment>
+constexpr void UnlinkNode(TreeHeader& header, NodeBase* pNode) noexcept {
+    NodeBase* pEnd = &header.m_endNode;
+
+    // the most left node has no left child, so the next one is the most left in its right subtree
+    // or its parent, the same for the most right node
+    if (pEnd->m_child[kLeft] == pNode) {
+        NodeBase* pNext = pNode->m_child[kRight] ? TreeMin(pNode->m_child[kRight])
+                                                 : pNode->m_pParent;
+        pEnd->m_child[kLeft] = pNext != pEnd ? pNext : nullptr;
+    }
+    if (pEnd->m_child[kRight] == pNode) {
+        NodeBase* pPrev = pNode->m_child[kLeft] ? TreeMax(pNode->m_child[kLeft])
+                                                : pNode->m_pParent;
+        pEnd->m_child[kRight] = pPrev != pEnd ? pPrev : nullptr;
+    }
+
+    Color originalColor = pNode->m_color;
+    // `pTransplant` takes the place of the unlinked node, it can be `nullptr`, so its parent is
+    // tracked separately
+    NodeBase* pTransplant = nullptr;
+    NodeBase* pTransplantParent = nullptr;
+
+    if (pNode->m_child[kLeft] == nullptr) {
+        pTransplant = pNode->m_child[kRight];
+        pTransplantParent = pNode->m_pParent;
+        Transplant(header, pNode, pTransplant);
+    } else if (pNode->m_child[kRight] == nullptr) {
+        pTransplant = pNode->m_child[kLeft];
+        pTransplantParent = pNode->m_pParent;
+        Transplant(header, pNode, pTransplant);
+    } else {
+        // successor of the node takes its place
+        NodeBase* pSuccessor = TreeMin(pNode->m_child[kRight]);
+        originalColor = pSuccessor->m_color;
+        pTransplant = pSuccessor->m_child[kRight];
+
+        if (pSuccessor->m_pParent == pNode) {
+            pTransplantParent = pSuccessor;
+        } else {
+            pTransplantParent = pSuccessor->m_pParent;
+            Transplant(header, pSuccessor, pSuccessor->m_child[kRight]);
+            pSuccessor->m_child[kRight] = pNode->m_child[kRight];
+            pSuccessor->m_child[kRight]->m_pParent = pSuccessor;
+        }
+
+        Transplant(header, pNode, pSuccessor);
+        pSuccessor->m_child[kLeft] = pNode->m_child[kLeft];
+        pSuccessor->m_child[kLeft]->m_pParent = pSuccessor;
+        pSuccessor->m_color = pNode->m_color;
+    }
+
+    --header.m_size;
+    // all nodes with changed subtrees are on the path up from the parent of the transplant
+    UpdatePath<Augment>(header, pTransplantParent);
+
+    if (originalColor == Color::Black) {
+        RebalanceAfterRemove<Stats, Augment>(header, pTransplant, pTransplantParent);
+    }
+}
+
+// `Subtree` is a subtree cut out of a tree, its root has no parent, and its black height: the
+// number of black nodes on a path from the root down to a leaf.
+struct Subtree {
+    NodeBase* m_pRoot = nullptr;
+    std::size_t m_blackHeight = 0;
+};
+
+inline std::size_t BlackHeight(const NodeBase* pNode) noexcept {
+    std::size_t height = 0;
+    for (; pNode; pNode = pNode->m_child[kLeft]) {
+        height += pNode->m_color == Color::Black;
+    }
+    return height;
+}
+
+// `JoinSubtrees` links `left`, `pMiddle` and `right` into one tree, keys of `left` must be less
+// than the key of `pMiddle` and keys of `right` greater. `pMiddle` hangs on the inner spine of the
+// taller tree at the black height of the other one, then a red violation is fixed like after an
+// insertion, so it takes O(difference of black heights + 1).
+template <typename Stats = NoStats>
+inline Subtree JoinSubtrees(Subtree left, NodeBase* pMiddle, Subtree right) noexcept {
+    for (Subtree* pTree : {&left, &right}) {
+        if (pTree->m_pRoot && pTree->m_pRoot->m_color == Color::Red) {
+            SetColor<Stats>(pTree->m_pRoot, Color::Black);
+            ++pTree->m_blackHeight;
+        }
+    }
+
+    if (left.m_blackHeight == right.m_blackHeight) {
+        SetColor<Stats>(pMiddle, Color::Black);
+        pMiddle->m_pParent = nullptr;
+        pMiddle->m_child[kLeft] = left.m_pRoot;
+        pMiddle->m_child[kRight] = right.m_pRoot;
+        for (NodeBase* pChild : pMiddle->m_child) {
+            if (pChild) {
+                pChild->m_pParent = pMiddle;
+            }
+        }
+        return {pMiddle, left.m_blackHeight + 1};
+    }
+
+    // walk down the inner spine of the taller tree, i.e. to the right for the left one
+    const std::size_t dir = left.m_blackHeight > right.m_blackHeight ? kRight : kLeft;
+    const Subtree& tall = dir == kRight ? left : right;
+    const Subtree& shorter = dir == kRight ? right : left;
+
+    NodeBase* pParent = nullptr;
+    NodeBase* pCurrNode = tall.m_pRoot;
+    std::size_t height = tall.m_blackHeight;  // black height of `pCurrNode`
+    while (!IsBlack(pCurrNode) || height != shorter.m_blackHeight) {
+        height -= pCurrNode->m_color == Color::Black;
+        pParent = pCurrNode;
+        pCurrNode = pCurrNode->m_child[dir];
+    }
+
+    // `pMiddle` takes the place of `pCurrNode`, the subtrees under it have equal black heights
+    SetColor<Stats>(pMiddle, Color::Red);
+    pMiddle->m_pParent = pParent;
+    pParent->m_child[dir] = pMiddle;
+    pMiddle->m_child[!dir] = pCurrNode;
+    pMiddle->m_child[dir] = shorter.m_pRoot;
+    for (NodeBase* pChild : pMiddle->m_child) {
+        if (pChild) {
+            pChild->m_pParent = pMiddle;
+        }
+    }
+
+    TreeHeader header{};
+    header.m_endNode.m_pParent = tall.m_pRoot;
+    tall.m_pRoot->m_pParent = &header.m_endNode;
+    const bool heightGrew = RebalanceAfterInsert<Stats>(header, pMiddle);
+
+    NodeBase* pRoot = header.m_endNode.m_pParent;
+    pRoot->m_pParent = nullptr;
+    return {pRoot, tall.m_blackHeight + heightGrew};
+}
+
+// `ConcatSubtrees` links two trees, keys of `left` must be less than keys of `right`. The most
+// left node of `right` is unlinked and joins them.
+template <typename Stats = NoStats>
+inline Subtree ConcatSubtrees(Subtree left, Subtree right) noexcept {
+    if (!left.m_pRoot) {
+        return right;
+    }
+    if (!right.m_pRoot) {
+        return left;
+    }
+
+    NodeBase* pMiddle = TreeMin(right.m_pRoot);
+    TreeHeader header{};
+    header.m_endNode.m_pParent = right.m_pRoot;
+    right.m_pRoot->m_pParent = &header.m_endNode;
+    header.m_size = 1;  // the count is never read, it just shouldn't wrap
+    UnlinkNode<Stats>(header, pMiddle);
+
+    right.m_pRoot = header.m_endNode.m_pParent;
+    if (right.m_pRoot) {
+        right.m_pRoot->m_pParent = nullptr;
+    }
+    right.m_blackHeight = BlackHeight(right.m_pRoot);
+    return JoinSubtrees<Stats>(left, pMiddle, right);
+}
+
+// `SplitSubtree` splits a tree into nodes for which `isLeft` holds and the rest. `isLeft` must
+// hold for a prefix of nodes in order, e.g. for keys less than some bound. Nodes on the search
+// path are joined back with subtrees hanging off it, black heights of joined trees telescope, so
+// the whole split takes O(log n).
+template <typename Stats = NoStats, typename IsLeft>
+inline std::pair<Subtree, Subtree> SplitSubtree(Subtree tree, const IsLeft& isLeft) noexcept {
+    NodeBase* pRoot = tree.m_pRoot;
+    if (!pRoot) {
+        return {};
+    }
+
+    const std::size_t childHeight = tree.m_blackHeight - (pRoot->m_color == Color::Black);
+    const Subtree left{pRoot->m_child[kLeft], childHeight};
+    const Subtree right{pRoot->m_child[kRight], childHeight};
+    for (NodeBase* pChild : pRoot->m_child) {
+        if (pChild) {
+            pChild->m_pParent = nullptr;
+        }
+    }
+
+    if (isLeft(pRoot)) {
+        auto [lower, upper] = SplitSubtree<Stats>(right, isLeft);
+        return {JoinSubtrees<Stats>(left, pRoot, lower), upper};
+    }
+    auto [lower, upper] = SplitSubtree<Stats>(left, isLeft);
+    return {lower, JoinSubtrees<Stats>(upper, pRoot, right)};
+}
+
+/// `KeyValueType` helps to get a `key_type` and a `value_type` from some generic type `T`.
+template <typename T>
+struct KeyValueType {
+    using key_type = T;
+    using value_type = T;
+};
+
+template <typename T1, typename T2>
+struct KeyValueType<std::pair<T1, T2>> {
+    using key_type = T1;
+    using value_type = T2;
+};
+
+template <typename T1, typename T2>
+struct KeyValueType<const std::pair<T1, T2>> {
+    using key_type = T1;
+    using value_type = T2;
+};
+
+template <typename T>
+constexpr const T& Key(const T& val) noexcept {
+    return val;
+}
+
+template <typename T1, typename T2>
+constexpr const T1& Key(const std::pair<T1, T2>& val) noexcept {
+    return val.first;
+}
+
+template <typename T>
+constexpr const T& Value(const T& val) noexcept {
+    return val;
+}
+
+template <typename T1, typename T2>
+constexpr const T2& Value(const std::pair<T1, T2>& val) noexcept {
+    return val.second;
+}
+
+// `IsThreeWayCompare` is true if `Cmp` returns an ordering (like `std::compare_three_way`)
+// instead of `bool`.
+template <typename Cmp, typename K>
+inline constexpr bool IsThreeWayCompare =
+    std::is_convertible_v<std::invoke_result_t<const Cmp&, const K&, const K&>,
+                          std::partial_ordering> &&
+    !std::is_same_v<std::invoke_result_t<const Cmp&, const K&, const K&>, bool>;
+
+// `IsCheapCompare` is true if `Cmp` compares keys with a single instruction: `<` and `>` of the
+// same keys are folded into one comparison by a compiler.
+template <typename Cmp, typename K>
+inline constexpr bool IsCheapCompare =
+    std::is_arithmetic_v<K> &&
+    (std::is_same_v<Cmp, std::less<K>> || std::is_same_v<Cmp, std::less<>>);
+
+// `IsPrefixCompare` is true if `Cmp` orders `std::string` keys by their bytes, so the first bytes
+// of keys decide most comparisons.
+template <typename Cmp, typename K>
+inline constexpr bool IsPrefixCompare =
+    std::is_same_v<K, std::string> &&
+    (std::is_same_v<Cmp, std::less<K>> || std::is_same_v<Cmp, std::less<>> ||
+     std::is_same_v<Cmp, std::compare_three_way>);
+
+// `KeyPrefix` holds the first 16 bytes of a string key, padded with zeros, as big-endian words: the
+// order of prefixes as numbers is the order of their bytes.
+struct KeyPrefix {
+    static constexpr std::size_t kSize = 16;
+
+    std::uint64_t m_high = 0;
+    std::uint64_t m_low = 0;
+
+    static constexpr KeyPrefix Of(std::string_view key) noexcept {
+        KeyPrefix prefix{};
+        for (std::size_t i = 0; i < std::min(key.size(), kSize); ++i) {
+            const std::uint64_t byte = static_cast<unsigned char>(key[i]);
+            (i < 8 ? prefix.m_high : prefix.m_low) |= byte << (56 - 8 * (i % 8));
+        }
+        return prefix;
+    }
+
+    constexpr auto operator<=>(const KeyPrefix&) const noexcept = default;
+};
+
+// `PrefixNode` is a node of a tree with `std::string` keys, which caches the prefix of its key
+// next to the links. A comparison reads the heap buffer of the key only if both prefixes are equal
+// and both keys are longer than them.
+template <typename T>
+struct PrefixNode : public NodeBase {
+    constexpr PrefixNode(const NodeBase& base, T&& value)
+        : NodeBase{base}, m_prefix{KeyPrefix::Of(Key(value))}, m_value{std::move(value)} {}
+
+    KeyPrefix m_prefix;
+    T m_value;
+};
+
+// `PrefixSearchKey` is a key being searched for together with its prefix, which is computed once
+// per search.
+struct PrefixSearchKey {
+    const std::string& m_key;
+    KeyPrefix m_prefix;
+};
+
+};  // namespace internal
+
+/// `RbTree` is a red-black tree. `StatsPolicy` collects statistics of the work done by the tree,
+/// see `NoStats` and `TreeStats`.
+///
+/// Searches do one `Cmp` call per level and check equality once at the end. `Cmp` may also be a
+/// three-way comparator returning an ordering, e.g. `std::compare_three_way`, which is cheaper for
+/// keys like strings: then a search does one three-way comparison per level and stops at the
+/// equal key. Arithmetic keys with `std::less` are searched the same way, since both `<` and `>`
+/// take a single instruction.
+///
+/// Nodes of `std::string` keys ordered by `std::less` or `std::compare_three_way` cache the first
+/// 16 bytes of the key as two integers. Most comparisons of a descent are decided by the cached
+/// prefixes, without a miss on the heap buffer of the key; keys sharing longer prefixes, e.g. URLs
+/// of one host, fall back to the full comparison. Any other comparator turns the cache off.
+///
+/// An empty tree allocates nothing. `InlineNodes` (up to 64) nodes are stored inside the tree
+/// object itself and serve inserts before the heap is used, which suits lots of small trees. Nodes
+/// of such a tree can't be handed over, so moving it is O(n) and doesn't keep node addresses.
+/// Without inline nodes, insertion, lookups and iteration are `constexpr`: a tree can be built and
+/// destroyed within a constant expression, see `MakeStaticTree`.
+///
+/// `RemovePolicy` is `EagerRemove` or `LazyRemove`, which defers the restructuring work of
+/// removals to batched compactions.
+///
+/// `IterationPolicy` is `ParentSteps` or `InOrderThreads`, which makes every iterator step O(1)
+/// for scans at the cost of two pointers per node.
+///
+/// `PlacementPolicy` is `HeapNodes` or `RelocatableNodes`, which lets `Compact` move nodes into
+/// one block in a cache-friendly order.
+template <typename V,
+          typename Cmp = std::less<typename internal::KeyValueType<V>::key_type>,
+          typename StatsPolicy = NoStats,
+          std::size_t InlineNodes = 0,
+          typename RemovePolicy = EagerRemove,
+          typename IterationPolicy = ParentSteps,
+          typename PlacementPolicy = HeapNodes>
+class RbTree : private internal::TreeHeader {
+public:
+    using key_value_type = V;
+    using key_type = typename internal::KeyValueType<V>::key_type;
+    using value_type = typename internal::KeyValueType<V>::value_type;
+    using compare = Cmp;
+    using stats_policy = StatsPolicy;
+    using remove_policy = RemovePolicy;
+    using iteration_policy = IterationPolicy;
+    using placement_policy = PlacementPolicy;
+    using size_type = std::size_t;
+
+    using PlainNodeType = std::conditional_t<internal::IsPrefixCompare<Cmp, key_type>,
+                                             internal::PrefixNode<key_value_type>,
+                                             internal::Node<key_value_type>>;
+    using NodeType = std::conditional_t<IterationPolicy::kThreaded,
+                                        internal::ThreadedNode<PlainNodeType>,
+                                        PlainNodeType>;
+    using NodePtr = NodeType*;
+    using BaseType = internal::NodeBase;
+    using BasePtr = internal::NodeBase*;
+
+    /// `kIsMap` is true for `std::pair<K, M>` values, which map keys to values of type `M`.
+    static constexpr bool kIsMap = !std::is_same_v<key_type, key_value_type>;
+
+    /// `ConstIterator` walks values in the ascending order of keys. It stays valid until its node
+    /// is removed.
+    class ConstIterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = key_value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const key_value_type*;
+        using reference = const key_value_type&;
+
+        ConstIterator() noexcept = default;
+
+        constexpr reference operator*() const noexcept {
+            return static_cast<NodePtr>(m_pNode)->m_value;
+        }
+        constexpr pointer operator->() const noexcept {
+            return &static_cast<NodePtr>(m_pNode)->m_value;
+        }
+
+        constexpr ConstIterator& operator++() noexcept {
+            do {
+                m_pNode = NextNode(m_pNode);
+            } while (!IsLive(m_pNode));
+            return *this;
+        }
+
+        constexpr ConstIterator operator++(int) noexcept {
+            ConstIterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        constexpr ConstIterator& operator--() noexcept {
+            do {
+                m_pNode = PrevNode(m_pNode);
+            } while (!IsLive(m_pNode));
+            return *this;
+        }
+
+        constexpr ConstIterator operator--(int) noexcept {
+            ConstIterator copy = *this;
+            --*this;
+            return copy;
+        }
+
+        constexpr bool operator==(const ConstIterator& other) const noexcept {
+            return m_pNode == other.m_pNode;
+        }
+        constexpr bool operator!=(const ConstIterator& other) const noexcept {
+            return m_pNode != other.m_pNode;
+        }
+
+        /// Node returns the node of the iterator, it is not a value for the end iterator.
+        NodePtr Node() const noexcept { return static_cast<NodePtr>(m_pNode); }
+
+    private:
+        friend class RbTree;
+
+        constexpr explicit ConstIterator(const BaseType* pNode) noexcept
+            : m_pNode{const_cast<BasePtr>(pNode)} {}
+
+    private:
+        BasePtr m_pNode = nullptr;
+    };
+
+    /// `Cursor` is a finger into a tree: it remembers the last node a search reached, and the next
+    /// `Seek` climbs from it only until an ancestor bounds the key, then descends. A key at a
+    /// distance of `d` nodes takes O(log d) instead of O(log n), which suits sorted or clustered
+    /// lookups, e.g. a merge join. Removing the node of the finger invalidates the cursor, `Reset`
+    /// makes it start from the root again. With `LazyRemove` the finger never rests on a dead node,
+    /// so a compaction, which frees them, doesn't invalidate it.
+    class Cursor {
+    public:
+        explicit Cursor(const RbTree& tree) noexcept : m_pTree{std::addressof(tree)} {}
+
+        /// Seek returns the node holding `key` or `nullptr`. The finger moves to that node, or to
+        /// the last live node of the search if there is no such key.
+        NodePtr Seek(const key_type& key) noexcept {
+            const RbTree& tree = *m_pTree;
+            BasePtr pSubtree = m_pFinger ? m_pFinger : tree.m_endNode.m_pParent;
+            if (!pSubtree) {
+                return nullptr;
+            }
+
+            decltype(auto) searchKey = tree.SearchKeyOf(key);
+            const auto compareTo = [&tree, &searchKey](BasePtr pNode) {
+                return tree.CompareTo(searchKey, static_cast<NodePtr>(pNode));
+            };
+
+            const auto order = compareTo(pSubtree);
+            if (order == 0) {
+                return Found(pSubtree);
+            }
+            const std::size_t dir = order < 0 ? kLeft : kRight;
+
+            // climb while `key` is beyond the subtree: only a parent, which the subtree hangs
+            // off on the other side, bounds it in direction `dir`
+            while (pSubtree->m_pParent->m_pParent != pSubtree) {
+                BasePtr pParent = pSubtree->m_pParent;
+                if (pParent->m_child[!dir] == pSubtree) {
+                    const auto parentOrder = compareTo(pParent);
+                    if (parentOrder == 0) {
+                        if (IsLive(pParent)) {
+                            m_pFinger = pParent;
+                        }
+                        return Found(pParent);
+                    }
+                    if ((parentOrder < 0) != (dir == kLeft)) {
+                        break;  // `key` is between the finger and the parent
+                    }
+                }
+                pSubtree = pParent;
+            }
+
+            // the finger is live, so it stays if the path has no live node
+            BasePtr pLive = m_pFinger;
+            for (BasePtr pNode = pSubtree; pNode;) {
+                if (IsLive(pNode)) {
+                    pLive = pNode;
+                }
+                const auto nodeOrder = compareTo(pNode);
+                if (nodeOrder == 0) {
+                    m_pFinger = pLive;
+                    return Found(pNode);
+                }
+                pNode = pNode->m_child[nodeOrder > 0];
+            }
+            m_pFinger = pLive;
+            return nullptr;
+        }
+
+        /// Node returns the node of the finger, `nullptr` before the first `Seek`.
+        NodePtr Node() const noexcept { return static_cast<NodePtr>(m_pFinger); }
+
+        /// Reset forgets the finger.
+        void Reset() noexcept { m_pFinger = nullptr; }
+
+    private:
+        static NodePtr Found(BasePtr pNode) noexcept {
+            return IsLive(pNode) ? static_cast<NodePtr>(pNode) : nullptr;
+        }
+
+    private:
+        const RbTree* m_pTree;
+        BasePtr m_pFinger = nullptr;
+    };
+
+public:
+    // Default constructor.
+    RbTree() = default;
+
+    /// Copy constructor.
+    RbTree(const RbTree& other) : m_compare{other.m_compare} { CopyFrom(other); }
+
+    /// Move constructor.
+    RbTree(RbTree&& other) noexcept(InlineNodes == 0)
+        : m_compare{std::move(other.m_compare)} {
+        MoveFrom(other);
+    }
+
+    /// Copy assignment operator. The tree is left empty if copying of a value throws.
+    RbTree& operator=(const RbTree& other) {
+        if (this != std::addressof(other)) {
+            Clear();
+            m_compare = other.m_compare;
+            CopyFrom(other);
+        }
+        return *this;
+    }
+
+    /// Move assignment operator.
+    RbTree& operator=(RbTree&& other) noexcept(InlineNodes == 0) {
+        if (this != std::addressof(other)) {
+            Clear();
+            m_compare = std::move(other.m_compare);
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    /// Destructor removes all nodes of a tree.
+    constexpr ~RbTree() { Clear(); }
+
+public:
+    /// Size returns current number of elements in container, dead nodes are not counted.
+    constexpr size_type Size() const noexcept { return m_size - DeadCount(); }
+
+    /// Empty returns true if size of container is 0, false otherwise.
+    constexpr bool Empty() const noexcept { return Size() == 0; }
+
+    /// Stats returns statistics of the calling thread collected by `StatsPolicy`. It is empty for
+    /// `NoStats`.
+    TreeStatsSnapshot Stats() const noexcept { return StatsPolicy::Snapshot(); }
+
+    /// ResetStats resets statistics of the calling thread collected by `StatsPolicy`.
+    void ResetStats() noexcept { StatsPolicy::Reset(); }
+
+    /// MemoryUsage returns a breakdown of memory owned by the tree in O(1): all nodes have the same
+    /// size, so it is computed from the number of nodes.
+    TreeMemoryUsage MemoryUsage() const noexcept {
+        TreeMemoryUsage usage{};
+        usage.m_nodeCount = m_size;
+        usage.m_heapNodeCount = m_size - m_inlineNodes.UsedCount() - m_arenaNodes.Count();
+        usage.m_nodeSize = sizeof(NodeType);
+        usage.m_linkSize = sizeof(BaseType) + (kPrefixKeys ? sizeof(internal::KeyPrefix) : 0) +
+                           (kThreaded ? 2 * sizeof(BasePtr) : 0);
+        usage.m_paddingSize = sizeof(NodeType) - usage.m_linkSize - sizeof(key_value_type);
+        usage.m_sentinelSize = sizeof(m_endNode);
+        usage.m_treeBytes = sizeof(RbTree);
+        usage.m_heapNodeBytes = usage.m_heapNodeCount * sizeof(NodeType);
+        usage.m_slackBytes =
+            usage.m_heapNodeCount * (internal::AllocationSize(sizeof(NodeType)) - sizeof(NodeType));
+        if constexpr (kRelocatable) {
+            usage.m_arenaBytes = m_arenaNodes.Arena() ? m_arenaNodes.Arena()->Bytes() : 0;
+        }
+        return usage;
+    }
+
+    /// MemoryUsage also adds heap bytes owned by keys and values: `ownedBytes(value)` returns them
+    /// for one value, e.g. a capacity of a long string. It visits every node, so it takes O(n).
+    template <typename OwnedBytes>
+    TreeMemoryUsage MemoryUsage(OwnedBytes&& ownedBytes) const {
+        TreeMemoryUsage usage = MemoryUsage();
+        if (m_size > 0) {
+            for (BasePtr pNode = m_endNode.m_child[kLeft]; pNode != &m_endNode;
+                 pNode = NextNode(pNode)) {
+                const key_value_type& val = static_cast<NodePtr>(pNode)->m_value;
+                usage.m_ownedBytes += ownedBytes(val);
+            }
+        }
+        return usage;
+    }
+
+    /// Clear removes all elements from the container.
+    constexpr void Clear() noexcept {
+        DestroySubtree(Root());
+        ResetHeader();
+    }
+
+    constexpr ConstIterator begin() const noexcept {
+        if (m_size == 0) {
+            return end();
+        }
+        ConstIterator first{m_endNode.m_child[kLeft]};
+        return IsLive(first.m_pNode) ? first : ++first;
+    }
+    constexpr ConstIterator end() const noexcept { return ConstIterator{&m_endNode}; }
+
+public:
+    /// Insert adds a new value to the container only if it is not presented in the tree.
+    constexpr NodePtr Insert(const key_value_type& val) noexcept { return InsertInternal(val); }
+
+    /// InsertOrUpdate adds new value to the tree or update already existing one.
+    constexpr NodePtr InsertOrUpdate(const key_value_type& val) noexcept {
+        return InsertInternal(val, true);
+    }
+
+    /// TryEmplace constructs a mapped value from `args` only if `key` is not in the tree, with a
+    /// single descent. Returns the node holding `key` and true if it was inserted.
+    template <typename... Args>
+    std::pair<NodePtr, bool> TryEmplace(const key_type& key, Args&&... args)
+        requires kIsMap
+    {
+        return EmplaceUnique(key, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    std::pair<NodePtr, bool> TryEmplace(key_type&& key, Args&&... args)
+        requires kIsMap
+    {
+        return EmplaceUnique(std::move(key), std::forward<Args>(args)...);
+    }
+
+    /// InsertOrAssign assigns `mapped` to the value of `key` in place or inserts a new one. Returns
+    /// the node holding `key` and true if it was inserted.
+    template <typename M>
+    std::pair<NodePtr, bool> InsertOrAssign(const key_type& key, M&& mapped)
+        requires kIsMap
+    {
+        const InsertPosition position = Locate(key);
+        if (position.m_pFound) {
+            const bool isLive = IsLive(position.m_pFound);
+            if constexpr (kLazy) {
+                m_deadNodes.m_count -= !isLive;
+                position.m_pFound->m_isDead = false;
+            }
+            position.m_pFound->m_value.second = std::forward<M>(mapped);
+            return {position.m_pFound, !isLive};
+        }
+        return {LinkNewNode(position, key, std::forward<M>(mapped)), true};
+    }
+
+    /// Upsert calls `fn(value_type&)` for the value of `key` in place, a missing value is
+    /// value-initialized and inserted first. `map.Upsert(key, [n](auto& v) { v += n; })` counts
+    /// with a single descent.
+    template <typename Fn>
+    value_type& Upsert(const key_type& key, Fn&& fn)
+        requires kIsMap
+    {
+        value_type& mapped = TryEmplace(key).first->m_value.second;
+        std::forward<Fn>(fn)(mapped);
+        return mapped;
+    }
+
+    /// `operator[]` returns the value of `key`, a missing one is value-initialized and inserted.
+    value_type& operator[](const key_type& key)
+        requires kIsMap
+    {
+        return TryEmplace(key).first->m_value.second;
+    }
+
+    value_type& operator[](key_type&& key)
+        requires kIsMap
+    {
+        return TryEmplace(std::move(key)).first->m_value.second;
+    }
+
+    /// At returns the value of `key` and throws `std::out_of_range` if there is no such key.
+    value_type& At(const key_type& key)
+        requires kIsMap
+    {
+        NodePtr pNode = Find(key);
+        if (!pNode) {
+            throw std::out_of_range("key is not in the tree");
+        }
+        return pNode->m_value.second;
+    }
+
+    const value_type& At(const key_type& key) const
+        requires kIsMap
+    {
+        return const_cast<RbTree&>(*this).At(key);
+    }
+
+    /// Find returns a node, which holds a `key`.
+    constexpr NodePtr Find(const key_type& key) const noexcept {
+        NodePtr pCurrNode = Root();
+        size_type depth = 0;
+
+        if constexpr (kEarlyExit) {
+            decltype(auto) searchKey = SearchKeyOf(key);
+            while (pCurrNode) {
+                const auto order = CompareTo(searchKey, pCurrNode);
+                if (order < 0) {
+                    pCurrNode = Left(pCurrNode);
+                } else if (order > 0) {
+                    pCurrNode = Right(pCurrNode);
+                } else {
+                    StatsPolicy::OnFind(depth);
+                    return IsLive(pCurrNode) ? pCurrNode : nullptr;
+                }
+                ++depth;
+            }
+
+            StatsPolicy::OnFind(depth);
+            return nullptr;
+        } else {
+            // `pCandidate` is the last node, which is not less than `key`, it is the only one to
+            // check for equality
+            NodePtr pCandidate = nullptr;
+
+            while (pCurrNode) {
+                if (Less(KeyOf(pCurrNode), key)) {
+                    pCurrNode = Right(pCurrNode);
+                } else {
+                    pCandidate = pCurrNode;
+                    pCurrNode = Left(pCurrNode);
+                }
+                ++depth;
+            }
+
+            StatsPolicy::OnFind(depth);
+            if (pCandidate && !Less(key, KeyOf(pCandidate)) && IsLive(pCandidate)) {
+                return pCandidate;
+            }
+            return nullptr;
+        }
+    }
+
+    /// LowerBound returns an iterator to the first value, which key is not less than `key`, e.g.
+    /// the start of a range scan.
+    constexpr ConstIterator LowerBound(const key_type& key) const noexcept {
+        const BaseType* pBound = &m_endNode;
+        for (BasePtr pNode = m_endNode.m_pParent; pNode;) {
+            if (Less(KeyOf(static_cast<NodePtr>(pNode)), key)) {
+                pNode = pNode->m_child[kRight];
+            } else {
+                pBound = pNode;
+                pNode = pNode->m_child[kLeft];
+            }
+        }
+        ConstIterator bound{pBound};
+        return IsLive(pBound) ? bound : ++bound;
+    }
+
+    /// Contains retuns true if value with `key` is presented in the tree.
+    constexpr bool Contains(const key_type& key) const noexcept { return Find(key) != nullptr; }
+
+    /// Min returns the node with the least key in O(1), or `nullptr` if the tree is empty. Dead
+    /// nodes at the edge of a tree with `LazyRemove` are stepped over.
+    constexpr NodePtr Min() const noexcept { return LiveExtreme(kLeft); }
+
+    /// Max returns the node with the greatest key in O(1), or `nullptr` if the tree is empty.
+    constexpr NodePtr Max() const noexcept { return LiveExtreme(kRight); }
+
+    /// PopMin removes the node with the least key without a search, e.g. the earliest timer.
+    void PopMin() noexcept { PopExtreme(kLeft); }
+
+    /// PopMax removes the node with the greatest key without a search.
+    void PopMax() noexcept { PopExtreme(kRight); }
+
+    /// `Remove` removes element with key node and re-balance the tree if needed. With
+    /// `LazyRemove` the node is only marked dead.
+    void Remove(const key_type& key) {
+        NodePtr pNodeToRemove = Find(key);
+
+        if (!pNodeToRemove) {
+            return;
+        }
+
+        if constexpr (kLazy) {
+            Bury(pNodeToRemove);
+        } else {
+            DestroyNode(pNodeToRemove);
+        }
+    }
+
+    /// `Erase` removes `pNode` of this tree, e.g. one returned by `Find`, without a search: the
+    /// successor takes amortized O(1) and rebalancing starts right at the node. Returns the next
+    /// node or `nullptr` if `pNode` was the last one.
+    NodePtr Erase(NodePtr pNode) noexcept {
+        BasePtr pNext = NextNode(pNode);
+        if constexpr (kLazy) {
+            while (!IsLive(pNext)) {
+                pNext = NextNode(pNext);
+            }
+            Bury(pNode);  // a compaction keeps live nodes where they are
+        } else {
+            DestroyNode(pNode);
+        }
+        return pNext != &m_endNode ? static_cast<NodePtr>(pNext) : nullptr;
+    }
+
+    /// `Erase` removes the value at `position`, which must not be `end()`, and returns an
+    /// iterator to the next one.
+    ConstIterator Erase(ConstIterator position) noexcept {
+        NodePtr pNext = Erase(position.Node());
+        return pNext ? ConstIterator{pNext} : end();
+    }
+
+    /// EraseRange removes values with keys in `[lo, hi)` and returns their number. The range is
+    /// cut out with two splits and a join in O(log n), nodes are freed in one pass without any
+    /// rebalancing.
+    size_type EraseRange(const key_type& lo, const key_type& hi) {
+        if (!Less(lo, hi)) {
+            return 0;
+        }
+        return DestroyDetached(DetachRange(&lo, &hi));
+    }
+
+    /// EraseRange removes values in `[first, last)` and returns `last`.
+    ConstIterator EraseRange(ConstIterator first, ConstIterator last) {
+        if (first != last) {
+            const key_type* pHi = last != end() ? &KeyOf(last.Node()) : nullptr;
+            DestroyDetached(DetachRange(&KeyOf(first.Node()), pHi));
+        }
+        return last;
+    }
+
+    /// ExtractRange moves values with keys in `[lo, hi)` into a new tree without copying them, so
+    /// a caller decides when and on which thread their nodes are freed. Only counting moved
+    /// nodes takes linear time.
+    RbTree ExtractRange(const key_type& lo, const key_type& hi) {
+        static_assert(InlineNodes == 0, "inline nodes can't be moved to another tree");
+
+        RbTree extracted{};
+        if (Less(lo, hi)) {
+            NodePtr pRoot = DetachRange(&lo, &hi);
+            const size_type count = CountSubtree(pRoot);
+            m_size -= count;
+            extracted.AdoptRoot(pRoot, count);
+            if constexpr (kRelocatable) {
+                if (m_arenaNodes.Arena()) {
+                    m_arenaNodes.Share(extracted.m_arenaNodes, CountArenaNodes(pRoot));
+                }
+            }
+            if constexpr (kLazy) {
+                const size_type deadCount = CountDead(pRoot);
+                m_deadNodes.m_count -= deadCount;
+                extracted.m_deadNodes.m_count = deadCount;
+            }
+        }
+        return extracted;
+    }
+
+    /// Compact frees dead nodes and relinks live ones into a perfectly balanced tree in O(n),
+    /// values don't move. `Remove` of a tree with `LazyRemove` calls it when dead nodes cross the
+    /// threshold.
+    void Compact() noexcept {
+        if (m_size == 0) {
+            return;
+        }
+
+        // turn the tree into a vine: a list of nodes in order linked by right children
+        BaseType head{};
+        head.m_child[kRight] = m_endNode.m_pParent;
+        BasePtr pTail = &head;
+        for (BasePtr pRest = m_endNode.m_pParent; pRest;) {
+            if (BasePtr pLeft = pRest->m_child[kLeft]) {
+                pRest->m_child[kLeft] = pLeft->m_child[kRight];
+                pLeft->m_child[kRight] = pRest;
+                pRest = pLeft;
+                pTail->m_child[kRight] = pLeft;
+            } else {
+                pTail = pRest;
+                pRest = pRest->m_child[kRight];
+            }
+        }
+
+        // drop dead nodes from the vine
+        size_type liveCount = 0;
+        for (BasePtr pPrev = &head; BasePtr pNode = pPrev->m_child[kRight];) {
+            if (IsLive(pNode)) {
+                pPrev = pNode;
+                ++liveCount;
+            } else {
+                pPrev->m_child[kRight] = pNode->m_child[kRight];
+                DeallocateNode(static_cast<NodePtr>(pNode));
+            }
+        }
+
+        BasePtr pList = head.m_child[kRight];
+        auto nextNode = [&pList] {
+            BasePtr pNode = pList;
+            pList = pList->m_child[kRight];
+            return pNode;
+        };
+        ResetHeader();
+        AdoptRoot(BuildSubtree(nextNode, liveCount, 0, RedDepth(liveCount)), liveCount);
+        LinkThreads();
+    }
+
+    /// Compact also moves all nodes into one fresh block in `order`, so lookups and scans of a
+    /// tree scattered over the heap by a long churn touch fewer cache lines and pages. The block
+    /// is aligned to 2 MiB and advised for transparent huge pages with `hugePages`. Values are
+    /// moved, so pointers to nodes are invalidated. The tree stays fully mutable: new nodes come
+    /// from the heap, and the block is freed with the last node in it. It takes O(n) time and
+    /// allocates the block before any node is touched, so `std::bad_alloc` leaves the tree as is.
+    /// Only a tree with `RelocatableNodes` has it.
+    void Compact(NodeOrder order, bool hugePages = false)
+        requires(PlacementPolicy::kRelocatable &&
+                 std::is_nothrow_move_constructible_v<key_value_type>)
+    {
+        Compact();
+        if (m_size == 0) {
+            return;
+        }
+
+        std::vector<BasePtr> nodes{};
+        nodes.reserve(m_size);
+        if (order == NodeOrder::BreadthFirst) {
+            nodes.push_back(m_endNode.m_pParent);
+            for (size_type i = 0; i < nodes.size(); ++i) {
+                for (BasePtr pChild : nodes[i]->m_child) {
+                    if (pChild) {
+                        nodes.push_back(pChild);
+                    }
+                }
+            }
+        } else {
+            // `Compact` leaves a perfectly balanced tree
+            VanEmdeBoasOrder(m_endNode.m_pParent, static_cast<size_type>(std::bit_width(m_size)),
+                             nodes);
+        }
+
+        auto* pArena = new internal::NodeArena{nodes.size() * sizeof(NodeType), hugePages};
+        internal::ArenaNodes<true> arenaNodes{pArena, nodes.size()};
+        // a parent is placed before its children and keeps its new address in the old parent link
+        for (BasePtr pOld : nodes) {
+            BasePtr pOldParent = pOld->m_pParent;
+            BasePtr pParent = pOldParent == &m_endNode ? &m_endNode : pOldParent->m_pParent;
+            const BaseType base{pOld->m_color, false, pParent, {nullptr, nullptr}};
+            NodePtr pNode = ::new (pArena->Take(sizeof(NodeType)))
+                NodeType{base, std::move(static_cast<NodePtr>(pOld)->m_value)};
+            if (pParent == &m_endNode) {
+                m_endNode.m_pParent = pNode;
+            } else {
+                pParent->m_child[internal::ChildDir(pOld)] = pNode;
+            }
+            pOld->m_pParent = pNode;
+        }
+
+        for (BasePtr pOld : nodes) {
+            DeallocateNode(static_cast<NodePtr>(pOld));
+        }
+        m_arenaNodes = std::move(arenaNodes);
+        m_endNode.m_child[kLeft] = internal::TreeMin(m_endNode.m_pParent);
+        m_endNode.m_child[kRight] = internal::TreeMax(m_endNode.m_pParent);
+        LinkThreads();
+    }
+
+    bool operator==(const RbTree& other) const noexcept {
+        if (this == std::addressof(other)) {
+            return true;
+        }
+        if constexpr (kLazy) {
+            // trees with tombstones are compared by live values only
+            return Size() == other.Size() && std::equal(begin(), end(), other.begin());
+        } else {
+            return TreesAreEqual(Root(), other.Root());
+        }
+    }
+
+    bool operator!=(const RbTree& other) const noexcept { return !(*this == other); }
+
+    void Dump() const { Print(std::cout, Root(), 0, false); }
+
+public:
+    /// Default size of blocks used by `Serialize` and `Deserialize`.
+    static constexpr size_type kDefaultBlockSize = 1 << 16;
+
+    /// Serialize writes all values in the ascending order to a binary stream: a header with the
+    /// number of values followed by values encoded by `ads::Serializer`. Writes are collected into
+    /// blocks of `blockSize` bytes (0 disables buffering), so memory usage doesn't depend on the
+    /// size of the tree.
+    void Serialize(std::ostream& out, size_type blockSize = kDefaultBlockSize) const {
+        internal::BlockWriter<internal::StreamSink> writer{internal::StreamSink{out}, blockSize};
+        SerializeInternal(writer);
+    }
+
+    /// Serialize writes the tree to a file descriptor, see `Serialize(std::ostream&)`.
+    void Serialize(int fd, size_type blockSize = kDefaultBlockSize) const {
+        internal::BlockWriter<internal::FdSink> writer{internal::FdSink{fd}, blockSize};
+        SerializeInternal(writer);
+    }
+
+    /// Deserialize replaces content of the tree with values read from a stream written by
+    /// `Serialize`. The tree is built bottom-up in O(n) without comparisons and rotations. Up to
+    /// `blockSize` bytes past the end of the tree may be consumed from the stream. Throws
+    /// `std::ios_base::failure` if the stream is truncated or has an unknown format, the tree is
+    /// left empty in this case.
+    void Deserialize(std::istream& in, size_type blockSize = kDefaultBlockSize) {
+        internal::BlockReader<internal::StreamSource> reader{internal::StreamSource{in},
+                                                             blockSize};
+        DeserializeInternal(reader);
+    }
+
+    /// Deserialize reads the tree from a file descriptor, see `Deserialize(std::istream&)`.
+    void Deserialize(int fd, size_type blockSize = kDefaultBlockSize) {
+        internal::BlockReader<internal::FdSource> reader{internal::FdSource{fd}, blockSize};
+        DeserializeInternal(reader);
+    }
+
+private:
+    template <typename Writer>
+    void SerializeInternal(Writer& writer) const {
+        const std::uint64_t size = Size();
+        writer.Write(internal::kStreamMagic, sizeof(internal::kStreamMagic));
+        writer.Write(&internal::kStreamVersion, sizeof(internal::kStreamVersion));
+        writer.Write(&size, sizeof(size));
+
+        for (const key_value_type& val : *this) {
+            Serializer<key_value_type>::Write(writer, val);
+        }
+
+        writer.Flush();
+    }
+
+    template <typename Reader>
+    void DeserializeInternal(Reader& reader) {
+        Clear();
+
+        char magic[sizeof(internal::kStreamMagic)] = {};
+        std::uint64_t version = 0;
+        std::uint64_t size = 0;
+        reader.Read(magic, sizeof(magic));
+        reader.Read(&version, sizeof(version));
+        reader.Read(&size, sizeof(size));
+
+        if (std::memcmp(magic, internal::kStreamMagic, sizeof(magic)) != 0 ||
+            version != internal::kStreamVersion) {
+            throw std::ios_base::failure("unknown format of a tree stream");
+        }
+        if (size == 0) {
+            return;
+        }
+
+        auto nextNode = [this, &reader]() -> BasePtr {
+            key_value_type val{};
+            Serializer<key_value_type>::Read(reader, val);
+            return AllocateNode(nullptr, internal::Color::Black, std::move(val));
+        };
+        AdoptRoot(BuildSubtree(nextNode, size, 0, RedDepth(size)), size);
+        LinkThreads();
+    }
+
+    // `RedDepth` returns the depth of red nodes in a perfectly balanced tree of `size` nodes: all
+    // levels but the last one are complete, nodes of the last level are red.
+    static size_type RedDepth(size_type size) noexcept {
+        size_type redDepth = 0;
+        while ((size_type{2} << redDepth) - 1 <= size) {
+            ++redDepth;
+        }
+        return redDepth;
+    }
+
+    // `VanEmdeBoasOrder` appends nodes of the top `height` levels of a subtree in the van Emde Boas
+    // order: the top half of the levels first, then every subtree hanging below it.
+    static void VanEmdeBoasOrder(BasePtr pRoot, size_type height, std::vector<BasePtr>& nodes) {
+        if (!pRoot || height == 0) {
+            return;
+        }
+        if (height == 1) {
+            nodes.push_back(pRoot);
+            return;
+        }
+
+        const size_type topHeight = height / 2;
+        VanEmdeBoasOrder(pRoot, topHeight, nodes);
+        const auto visitBottom = [&](auto& self, BasePtr pNode, size_type depth) -> void {
+            if (!pNode) {
+                return;
+            }
+            if (depth == topHeight) {
+                VanEmdeBoasOrder(pNode, height - topHeight, nodes);
+                return;
+            }
+            self(self, pNode->m_child[kLeft], depth + 1);
+            self(self, pNode->m_child[kRight], depth + 1);
+        };
+        visitBottom(visitBottom, pRoot, 0);
+    }
+
+    // `BuildSubtree` takes `count` nodes in order from `nextNode()` and links a perfectly balanced
+    // subtree of them. The recursion depth is logarithmic, so memory usage is bounded.
+    template <typename NextNode>
+    BasePtr BuildSubtree(NextNode& nextNode, size_type count, size_type depth, size_type redDepth) {
+        if (count == 0) {
+            return nullptr;
+        }
+
+        const size_type leftCount = (count - 1) / 2;
+        BasePtr pSubtree = BuildSubtree(nextNode, leftCount, depth + 1, redDepth);
+
+        try {
+            BasePtr pNode = nextNode();
+            pNode->m_color = depth == redDepth ? internal::Color::Red : internal::Color::Black;
+            pNode->m_child[kLeft] = pSubtree;
+            if (pSubtree) {
+                pSubtree->m_pParent = pNode;
+            }
+            pSubtree = pNode;
+
+            pNode->m_child[kRight] =
+                BuildSubtree(nextNode, count - leftCount - 1, depth + 1, redDepth);
+            if (pNode->m_child[kRight]) {
+                pNode->m_child[kRight]->m_pParent = pNode;
+            }
+        } catch (...) {
+            DestroySubtree(static_cast<NodePtr>(pSubtree));
+            throw;
+        }
+
+        return pSubtree;
+    }
+
+private:
+    void Print(std::ostream& out, NodePtr pNode, size_type level, bool isLeftChild) const {
+        if (!pNode) {
+            out << "{ }\n";
+            return;
+        }
+        if (level > 0) {
+            for (size_type i = 0; i < level - 1; ++i) {
+                out << "|   ";
+            }
+            out << "|---";
+        }
+
+        out << "{ " << pNode->m_value;
+        if (level > 0) {
+            out << ", " << (isLeftChild ? "Left, " : "Right, ");
+        } else {
+            out << ", Root, ";
+        }
+        out << (pNode->m_color == internal::Color::Black ? "Black }\n" : "Red }\n");
+
+        if (pNode->m_child[kLeft]) {
+            Print(out, Left(pNode), level + 1, true);
+        }
+        if (pNode->m_child[kRight]) {
+            Print(out, Right(pNode), level + 1, false);
+        }
+    }
+
+    constexpr NodePtr Root() const noexcept { return static_cast<NodePtr>(m_endNode.m_pParent); }
+
+    constexpr bool Less(const key_type& lhs, const key_type& rhs) const noexcept {
+        StatsPolicy::OnCompare();
+        if constexpr (kThreeWayCompare) {
+            return m_compare(lhs, rhs) < 0;
+        } else {
+            return m_compare(lhs, rhs);
+        }
+    }
+
+    // `Compare` orders keys by a three-way comparator or by `<` applied twice to cheap keys.
+    constexpr auto Compare(const key_type& lhs, const key_type& rhs) const noexcept {
+        if constexpr (kThreeWayCompare) {
+            StatsPolicy::OnCompare();
+            return m_compare(lhs, rhs);
+        } else if (Less(lhs, rhs)) {
+            return std::weak_ordering::less;
+        } else if (Less(rhs, lhs)) {
+            return std::weak_ordering::greater;
+        } else {
+            return std::weak_ordering::equivalent;
+        }
+    }
+
+    // `SearchKeyOf` prepares `key` for a descent, the prefix of a string key is computed only once.
+    constexpr decltype(auto) SearchKeyOf(const key_type& key) const noexcept {
+        if constexpr (kPrefixKeys) {
+            return internal::PrefixSearchKey{key, internal::KeyPrefix::Of(key)};
+        } else {
+            return key;
+        }
+    }
+
+    // `CompareTo` orders a key prepared by `SearchKeyOf` and the key of `pNode`.
+    constexpr auto CompareTo(const key_type& key, NodePtr pNode) const noexcept {
+        return Compare(key, KeyOf(pNode));
+    }
+
+    constexpr std::weak_ordering CompareTo(const internal::PrefixSearchKey& key,
+                                           NodePtr pNode) const noexcept {
+        if (const auto order = key.m_prefix <=> pNode->m_prefix; order != 0) {
+            StatsPolicy::OnCompare();
+            return order;
+        }
+        // a key, which fits into the prefix, is a prefix of the other one or equal to it
+        const key_type& nodeKey = KeyOf(pNode);
+        if (std::min(key.m_key.size(), nodeKey.size()) <= internal::KeyPrefix::kSize) {
+            StatsPolicy::OnCompare();
+            return key.m_key.size() <=> nodeKey.size();
+        }
+        // comparators of `IsPrefixCompare` order strings by bytes, the first `kSkip` are equal
+        StatsPolicy::OnCompare();
+        constexpr std::size_t kSkip = internal::KeyPrefix::kSize;
+        const std::string_view keyTail = std::string_view{key.m_key}.substr(kSkip);
+        return keyTail.compare(std::string_view{nodeKey}.substr(kSkip)) <=> 0;
+    }
+
+    static constexpr const key_type& KeyOf(NodePtr pNode) noexcept {
+        return internal::Key(pNode->m_value);
+    }
+
+    // `NextNode` and `PrevNode` step to in-order neighbours: along threads with `InOrderThreads`,
+    // through parent links otherwise.
+    static constexpr BasePtr NextNode(BasePtr pNode) noexcept {
+        if constexpr (kThreaded) {
+            return static_cast<NodePtr>(pNode)->m_thread[kRight];
+        } else {
+            return internal::Next(pNode);
+        }
+    }
+
+    static constexpr BasePtr PrevNode(BasePtr pNode) noexcept {
+        if constexpr (kThreaded) {
+            if (internal::IsEndNode(pNode)) {
+                return pNode->m_child[kRight];
+            }
+            return static_cast<NodePtr>(pNode)->m_thread[kLeft];
+        } else {
+            return internal::Prev(pNode);
+        }
+    }
+
+    // `SetThread` links `pNode` to its neighbour in direction `dir`, the end node has no threads.
+    constexpr void SetThread(BasePtr pNode, std::size_t dir, BasePtr pNeighbour) noexcept {
+        if (pNode != &m_endNode) {
+            static_cast<NodePtr>(pNode)->m_thread[dir] = pNeighbour;
+        }
+    }
+
+    // `ThreadNewNode` puts a new leaf between its in-order neighbours, its parent is one of them.
+    constexpr void ThreadNewNode(NodePtr pNode, NodePtr pParent, std::size_t dir) noexcept {
+        if (!pParent) {
+            pNode->m_thread[kLeft] = &m_endNode;
+            pNode->m_thread[kRight] = &m_endNode;
+            return;
+        }
+        pNode->m_thread[1 - dir] = pParent;
+        pNode->m_thread[dir] = pParent->m_thread[dir];
+        SetThread(pNode->m_thread[dir], 1 - dir, pNode);
+        pParent->m_thread[dir] = pNode;
+    }
+
+    // `LinkThreads` threads all nodes in order after the tree was rebuilt in O(n).
+    void LinkThreads() noexcept {
+        if constexpr (kThreaded) {
+            BasePtr pPrev = &m_endNode;
+            if (m_endNode.m_pParent) {
+                for (BasePtr pNode = m_endNode.m_child[kLeft]; pNode != &m_endNode;
+                     pNode = internal::Next(pNode)) {
+                    static_cast<NodePtr>(pNode)->m_thread[kLeft] = pPrev;
+                    SetThread(pPrev, kRight, pNode);
+                    pPrev = pNode;
+                }
+            }
+            SetThread(pPrev, kRight, &m_endNode);
+        }
+    }
+
+    // `PopExtreme` unlinks the cached most left or right node, it has no child in direction
+    // `dir`, so unlinking takes no successor search.
+    void PopExtreme(std::size_t dir) noexcept {
+        // dead nodes at the edge go away too, they are in the way of the live one
+        while (NodePtr pNode = Child(&m_endNode, dir)) {
+            const bool isLive = IsLive(pNode);
+            DestroyNode(pNode);
+            if (isLive) {
+                return;
+            }
+        }
+    }
+
+    // `DestroyNode` unlinks a node from the tree and deallocates it.
+    void DestroyNode(NodePtr pNode) noexcept {
+        if constexpr (kLazy) {
+            m_deadNodes.m_count -= pNode->m_isDead;
+        }
+        if constexpr (kThreaded) {
+            SetThread(pNode->m_thread[kLeft], kRight, pNode->m_thread[kRight]);
+            SetThread(pNode->m_thread[kRight], kLeft, pNode->m_thread[kLeft]);
+        }
+        internal::UnlinkNode<StatsPolicy>(*this, pNode);
+        DeallocateNode(pNode);
+    }
+
+    // `IsLive` is false only for a node removed from a tree with `LazyRemove`. The end node is
+    // always live, so iteration stops at it.
+    static constexpr bool IsLive(const BaseType* pNode) noexcept {
+        if constexpr (kLazy) {
+            return !pNode->m_isDead;
+        } else {
+            return true;
+        }
+    }
+
+    constexpr size_type DeadCount() const noexcept {
+        if constexpr (kLazy) {
+            return m_deadNodes.m_count;
+        } else {
+            return 0;
+        }
+    }
+
+    constexpr NodePtr LiveExtreme(std::size_t dir) const noexcept {
+        BasePtr pNode = m_endNode.m_child[dir];
+        if constexpr (kLazy) {
+            while (pNode && !IsLive(pNode)) {
+                pNode = dir == kLeft ? NextNode(pNode) : PrevNode(pNode);
+            }
+            if (pNode == &m_endNode) {
+                return nullptr;
+            }
+        }
+        return static_cast<NodePtr>(pNode);
+    }
+
+    // `Bury` marks a node dead and compacts the tree once dead nodes exceed the threshold of
+    // `RemovePolicy`. The node keeps its value until then, so it can be revived in place.
+    void Bury(NodePtr pNode) noexcept {
+        pNode->m_isDead = true;
+        if (++m_deadNodes.m_count * 100 > m_size * RemovePolicy::kMaxDeadPercent) {
+            Compact();
+        }
+    }
+
+    // `Revive` puts a new value into a dead node found by a descent.
+    template <typename... Args>
+    constexpr NodePtr Revive(NodePtr pNode, Args&&... args) {
+        pNode->m_value = key_value_type(std::forward<Args>(args)...);
+        pNode->m_isDead = false;
+        --m_deadNodes.m_count;
+        return pNode;
+    }
+
+    // `DestroyDetached` deallocates a subtree cut out by `DetachRange`, returns a number of live
+    // nodes in it.
+    size_type DestroyDetached(NodePtr pRoot) noexcept {
+        const size_type deadCount = CountDead(pRoot);
+        const size_type count = DestroySubtree(pRoot);
+        m_size -= count;
+        if constexpr (kLazy) {
+            m_deadNodes.m_count -= deadCount;
+        }
+        return count - deadCount;
+    }
+
+    static size_type CountDead(BasePtr pNode) noexcept {
+        size_type count = 0;
+        if constexpr (kLazy) {
+            for (; pNode; pNode = pNode->m_child[kLeft]) {
+                count += CountDead(pNode->m_child[kRight]) + !IsLive(pNode);
+            }
+        }
+        return count;
+    }
+
+    size_type CountArenaNodes(BasePtr pNode) const noexcept {
+        size_type count = 0;
+        for (; pNode; pNode = pNode->m_child[kLeft]) {
+            count += CountArenaNodes(pNode->m_child[kRight]) + m_arenaNodes.Arena()->Owns(pNode);
+        }
+        return count;
+    }
+
+    // `InsertPosition` is where a descent for a key ends: the node holding the key or, if there is
+    // none, the parent of a new node and the direction to it.
+    struct InsertPosition {
+        NodePtr m_pFound = nullptr;
+        NodePtr m_pParent = nullptr;
+        std::size_t m_dir = kLeft;
+        size_type m_depth = 0;
+    };
+
+    constexpr InsertPosition Locate(const key_type& keyToInsert) const noexcept {
+        NodePtr pCurrNode = Root();
+        NodePtr pParentNode = nullptr;  // this node will be a parent of a new node
+
+        std::size_t dir = kLeft;  // direction from the parent to a new node
+        size_type depth = 0;
+        // the last node, which is not greater than `keyToInsert`, only it can hold an equal key
+        NodePtr pCandidate = nullptr;
+        [[maybe_unused]] decltype(auto) searchKey = SearchKeyOf(keyToInsert);
+
+        while (pCurrNode != nullptr) {
+            pParentNode = pCurrNode;
+
+            if constexpr (kEarlyExit) {
+                const auto order = CompareTo(searchKey, pCurrNode);
+                if (order < 0) {
+                    dir = kLeft;
+                } else if (order > 0) {
+                    dir = kRight;
+                } else {
+                    pCandidate = pCurrNode;
+                    break;
+                }
+            } else if (Less(keyToInsert, KeyOf(pCurrNode))) {
+                dir = kLeft;
+            } else {
+                dir = kRight;
+                pCandidate = pCurrNode;
+            }
+
+            pCurrNode = Child(pCurrNode, dir);
+            ++depth;
+        }
+
+        if (pCandidate && (kEarlyExit || !Less(KeyOf(pCandidate), keyToInsert))) {
+            return {pCandidate, nullptr, dir, depth};
+        }
+        return {nullptr, pParentNode, dir, depth};
+    }
+
+    // `LinkNewNode` constructs a value from `args` in a new node at `position`.
+    template <typename... Args>
+    constexpr NodePtr LinkNewNode(const InsertPosition& position, Args&&... args) {
+        StatsPolicy::OnInsert(position.m_depth);
+
+        NodePtr pNewNode = AllocateNode(position.m_pParent, internal::Color::Red,
+                                        std::forward<Args>(args)...);
+        internal::LinkNode<StatsPolicy>(*this, position.m_pParent, position.m_dir, pNewNode);
+        if constexpr (kThreaded) {
+            ThreadNewNode(pNewNode, position.m_pParent, position.m_dir);
+        }
+        return pNewNode;
+    }
+
+    constexpr NodePtr InsertInternal(const key_value_type& val,
+                                     bool updateIfExists = false) noexcept {
+        const InsertPosition position = Locate(internal::Key(val));
+        if (position.m_pFound) {
+            if constexpr (kLazy) {
+                if (position.m_pFound->m_isDead) {
+                    return Revive(position.m_pFound, val);
+                }
+            }
+            if (updateIfExists) {
+                position.m_pFound->m_value = val;
+            }
+            return position.m_pFound;
+        }
+        return LinkNewNode(position, val);
+    }
+
+    template <typename KeyArg, typename... Args>
+    std::pair<NodePtr, bool> EmplaceUnique(KeyArg&& key, Args&&... args) {
+        const InsertPosition position = Locate(key);
+        if (position.m_pFound) {
+            if constexpr (kLazy) {
+                if (position.m_pFound->m_isDead) {
+                    return {Revive(position.m_pFound, std::piecewise_construct,
+                                   std::forward_as_tuple(std::forward<KeyArg>(key)),
+                                   std::forward_as_tuple(std::forward<Args>(args)...)),
+                            true};
+                }
+            }
+            return {position.m_pFound, false};
+        }
+        NodePtr pNewNode = LinkNewNode(position, std::piecewise_construct,
+                                       std::forward_as_tuple(std::forward<KeyArg>(key)),
+                                       std::forward_as_tuple(std::forward<Args>(args)...));
+        return {pNewNode, true};
+    }
+
+private:
+    // `AllocateNode` constructs a value from `args` right in a new node. It takes a free inline
+    // slot if there is one, otherwise memory comes from the heap.
+    template <typename... Args>
+    constexpr NodePtr AllocateNode(BasePtr pParent, internal::Color color, Args&&... args) {
+        BaseType base{color, false, pParent, {nullptr, nullptr}};
+
+        if (void* pSlot = m_inlineNodes.Take()) {
+            try {
+                return ::new (pSlot) NodeType{base, key_value_type(std::forward<Args>(args)...)};
+            } catch (...) {
+                m_inlineNodes.Give(static_cast<NodePtr>(pSlot));
+                throw;
+            }
+        }
+        return new NodeType{base, key_value_type(std::forward<Args>(args)...)};
+    }
+
+    constexpr void DeallocateNode(NodePtr pNode) noexcept {
+        if (m_inlineNodes.Give(pNode)) {
+            pNode->~NodeType();
+        } else if (m_arenaNodes.Owns(pNode)) {
+            pNode->~NodeType();
+            m_arenaNodes.Drop();
+        } else {
+            delete pNode;
+        }
+    }
+
+    // `DestroySubtree` deallocates all nodes of a subtree and returns their number. It recurses
+    // only into right subtrees and loops over left ones.
+    constexpr size_type DestroySubtree(NodePtr pNode) noexcept {
+        size_type count = 0;
+        while (pNode) {
+            count += DestroySubtree(Right(pNode)) + 1;
+            NodePtr pLeft = Left(pNode);
+            DeallocateNode(pNode);
+            pNode = pLeft;
+        }
+        return count;
+    }
+
+    static size_type CountSubtree(BasePtr pNode) noexcept {
+        size_type count = 0;
+        for (; pNode; pNode = pNode->m_child[kLeft]) {
+            count += CountSubtree(pNode->m_child[kRight]) + 1;
+        }
+        return count;
+    }
+
+    // `DetachRange` cuts nodes with keys in `[*pLo, *pHi)` out of the tree, `pHi` is `nullptr` for
+    // no upper bound, and joins the rest back. The size is left to a caller. Returns the root of a
+    // valid red-black tree of cut nodes.
+    NodePtr DetachRange(const key_type* pLo, const key_type* pHi) noexcept {
+        BasePtr pRoot = m_endNode.m_pParent;
+        if (!pRoot) {
+            return nullptr;
+        }
+        pRoot->m_pParent = nullptr;
+
+        const auto isLess = [this](const key_type* pBound) {
+            return [this, pBound](BasePtr pNode) {
+                return Less(KeyOf(static_cast<NodePtr>(pNode)), *pBound);
+            };
+        };
+        const internal::Subtree tree{pRoot, internal::BlackHeight(pRoot)};
+        auto [lower, range] = internal::SplitSubtree<StatsPolicy>(tree, isLess(pLo));
+        internal::Subtree upper{};
+        if (pHi) {
+            std::tie(range, upper) = internal::SplitSubtree<StatsPolicy>(range, isLess(pHi));
+        }
+
+        // a subtree taken as is by a split can have a red root
+        const internal::Subtree rest = internal::ConcatSubtrees<StatsPolicy>(lower, upper);
+        for (BasePtr pPartRoot : {rest.m_pRoot, range.m_pRoot}) {
+            if (pPartRoot) {
+                pPartRoot->m_color = internal::Color::Black;
+            }
+        }
+
+        if constexpr (kThreaded) {
+            // the cut nodes are neighbours in order, their outer neighbours become adjacent
+            if (range.m_pRoot) {
+                NodePtr pFirst = static_cast<NodePtr>(internal::TreeMin(range.m_pRoot));
+                NodePtr pLast = static_cast<NodePtr>(internal::TreeMax(range.m_pRoot));
+                SetThread(pFirst->m_thread[kLeft], kRight, pLast->m_thread[kRight]);
+                SetThread(pLast->m_thread[kRight], kLeft, pFirst->m_thread[kLeft]);
+            }
+        }
+
+        const size_type size = m_size;
+        const internal::DeadNodes<kLazy> deadNodes = m_deadNodes;
+        ResetHeader();
+        AdoptRoot(rest.m_pRoot, size);
+        m_size = size;  // the range can be the whole tree, then there is no root to adopt
+        m_deadNodes = deadNodes;
+        return static_cast<NodePtr>(range.m_pRoot);
+    }
+
+    // `CloneSubtree` copies values of a subtree, or moves them if `kMove`, into new nodes of the
+    // same shape and colors. The recursion depth is logarithmic.
+    template <bool kMove>
+    BasePtr CloneSubtree(NodePtr pSource, BasePtr pParent) {
+        if (!pSource) {
+            return nullptr;
+        }
+
+        NodePtr pNode = nullptr;
+        if constexpr (kMove) {
+            pNode = AllocateNode(pParent, pSource->m_color, std::move(pSource->m_value));
+        } else {
+            pNode = AllocateNode(pParent, pSource->m_color, pSource->m_value);
+        }
+
+        pNode->m_isDead = pSource->m_isDead;
+        try {
+            pNode->m_child[kLeft] = CloneSubtree<kMove>(Left(pSource), pNode);
+            pNode->m_child[kRight] = CloneSubtree<kMove>(Right(pSource), pNode);
+        } catch (...) {
+            DestroySubtree(pNode);
+            throw;
+        }
+        return pNode;
+    }
+
+    void CopyFrom(const RbTree& other) {
+        AdoptRoot(CloneSubtree<false>(other.Root(), &m_endNode), other.m_size);
+        m_deadNodes = other.m_deadNodes;
+        LinkThreads();
+    }
+
+    // `MoveFrom` takes nodes of `other` if they are all on the heap, otherwise values are moved
+    // into new nodes. `other` is left empty.
+    void MoveFrom(RbTree& other) noexcept(InlineNodes == 0) {
+        if constexpr (InlineNodes == 0) {
+            AdoptRoot(other.m_endNode.m_pParent, other.m_size);
+            m_deadNodes = other.m_deadNodes;
+            m_arenaNodes = std::move(other.m_arenaNodes);
+            other.ResetHeader();
+        } else {
+            AdoptRoot(CloneSubtree<true>(other.Root(), &m_endNode), other.m_size);
+            m_deadNodes = other.m_deadNodes;
+            LinkThreads();
+            other.Clear();
+        }
+    }
+
+    // `AdoptRoot` links a complete subtree of `size` nodes as the tree.
+    void AdoptRoot(BasePtr pRoot, size_type size) noexcept {
+        if (!pRoot) {
+            return;
+        }
+        pRoot->m_pParent = &m_endNode;
+        m_endNode.m_pParent = pRoot;
+        m_endNode.m_child[kLeft] = internal::TreeMin(pRoot);
+        m_endNode.m_child[kRight] = internal::TreeMax(pRoot);
+        m_size = size;
+        if constexpr (kThreaded) {
+            // the extreme nodes link to the end node of the tree they came from
+            static_cast<NodePtr>(m_endNode.m_child[kLeft])->m_thread[kLeft] = &m_endNode;
+            static_cast<NodePtr>(m_endNode.m_child[kRight])->m_thread[kRight] = &m_endNode;
+        }
+    }
+
+    constexpr void ResetHeader() noexcept {
+        m_endNode.m_pParent = nullptr;
+        m_endNode.m_child[kLeft] = nullptr;
+        m_endNode.m_child[kRight] = nullptr;
+        m_size = 0;
+        m_deadNodes = {};
+    }
+
+    static constexpr NodePtr Left(BasePtr pNode) {
+        return static_cast<NodePtr>(pNode->m_child[kLeft]);
+    }
+
+    static constexpr NodePtr Right(BasePtr pNode) {
+        return static_cast<NodePtr>(pNode->m_child[kRight]);
+    }
+
+    static constexpr NodePtr Child(BasePtr pNode, std::size_t dir) noexcept {
+        return static_cast<NodePtr>(pNode->m_child[dir]);
+    }
+
+    static bool TreesAreEqual(const NodePtr lhs, const NodePtr rhs) {
+        if (!lhs && !rhs) {
+            return true;
+        }
+        if ((lhs && !rhs) || (!lhs && rhs)) {
+            return false;
+        }
+        if (lhs->m_value != rhs->m_value || lhs->m_color != rhs->m_color) {
+            return false;
+        }
+        return TreesAreEqual(Left(lhs), Left(rhs)) && TreesAreEqual(Right(lhs), Right(rhs));
+    }
+
+private:
+    static constexpr std::size_t kLeft = internal::kLeft;
+    static constexpr std::size_t kRight = internal::kRight;
+
+    static constexpr bool kThreeWayCompare = internal::IsThreeWayCompare<compare, key_type>;
+    static constexpr bool kPrefixKeys = internal::IsPrefixCompare<compare, key_type>;
+    // a descent stops at an equal key only if it doesn't take a second comparator call per level
+    static constexpr bool kEarlyExit =
+        kThreeWayCompare || kPrefixKeys || internal::IsCheapCompare<compare, key_type>;
+    static constexpr bool kLazy = RemovePolicy::kLazy;
+    static constexpr bool kThreaded = IterationPolicy::kThreaded;
+    static constexpr bool kRelocatable = PlacementPolicy::kRelocatable;
+
+    [[no_unique_address]] compare m_compare{};  // compare function / functor
+    [[no_unique_address]] internal::InlineNodePool<NodeType, InlineNodes> m_inlineNodes;
+    [[no_unique_address]] internal::DeadNodes<kLazy> m_deadNodes;
+    [[no_unique_address]] internal::ArenaNodes<kRelocatable> m_arenaNodes;  // relocated nodes
+};
+
+}  // namespace ads
@@ -0,0 +1,1205 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <compare>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <random>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+#include "BufferedRbTree.hpp"
+#include "PerfCounters.hpp"
+#include "RbTree.hpp"
+#include "SplitRbTree.hpp"
+#include "TopDownRbTree.hpp"
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Workload data
+
+/// `LargeValue` is a 256-byte element ordered by its key, it shows the cost of moving big values.
+struct LargeValue {
+    std::uint64_t m_key;
+    char m_payload[248];
+
+    bool operator<(const LargeValue& other) const noexcept { return m_key < other.m_key; }
+    bool operator==(const LargeValue& other) const noexcept { return m_key == other.m_key; }
+};
+
+struct LargeValueHash {
+    std::size_t operator()(const LargeValue& val) const noexcept {
+        return std::hash<std::uint64_t>{}(val.m_key);
+    }
+};
+
+/// `Mix` scatters ranks over the key space, so Zipfian hot keys are not neighbours in the tree.
+std::uint64_t Mix(std::uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/// `ZipfGenerator` draws ranks in [0, n) with probability proportional to 1 / rank^theta. It is
+/// the generator of Gray et al. used by YCSB, the setup is O(n) and every draw is O(1).
+class ZipfGenerator {
+public:
+    ZipfGenerator(std::uint64_t n, double theta) : m_n{n}, m_theta{theta} {
+        double zetan = 0.0;
+        for (std::uint64_t i = 1; i <= n; ++i) {
+            zetan += 1.0 / std::pow(static_cast<double>(i), theta);
+        }
+        const double zeta2 = 1.0 + 1.0 / std::pow(2.0, theta);
+        m_zetan = zetan;
+        m_alpha = 1.0 / (1.0 - theta);
+        m_eta = (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - theta)) / (1.0 - zeta2 / zetan);
+    }
+
+    template <typename Generator>
+    std::uint64_t operator()(Generator& generator) {
+        const double u = std::uniform_real_distribution<double>{0.0, 1.0}(generator);
+        const double uz = u * m_zetan;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + std::pow(0.5, m_theta)) {
+            return 1;
+        }
+        const auto rank = static_cast<std::uint64_t>(static_cast<double>(m_n) *
+                                                     std::pow(m_eta * u - m_eta + 1.0, m_alpha));
+        return std::min(rank, m_n - 1);
+    }
+
+private:
+    std::uint64_t m_n;
+    double m_theta;
+    double m_zetan = 0.0;
+    double m_alpha = 0.0;
+    double m_eta = 0.0;
+};
+
+template <typename E>
+E MakeElement(std::uint64_t key);
+
+template <>
+std::uint64_t MakeElement<std::uint64_t>(std::uint64_t key) {
+    return key;
+}
+
+template <>
+std::string MakeElement<std::string>(std::uint64_t key) {
+    // 24-40 characters with a common prefix, like identifiers or paths
+    std::string str = "key/";
+    const std::size_t length = 20 + key % 17;
+    std::uint64_t bits = Mix(key);
+    while (str.size() < length) {
+        str.push_back(static_cast<char>('a' + bits % 26));
+        bits = bits / 26 ? bits / 26 : Mix(bits + key);
+    }
+    return str;
+}
+
+template <>
+LargeValue MakeElement<LargeValue>(std::uint64_t key) {
+    LargeValue val{};
+    val.m_key = key;
+    std::memset(val.m_payload, static_cast<int>(key & 0x7f), sizeof(val.m_payload));
+    return val;
+}
+
+/// `MakeUrl` returns a URL on one of 256 hosts: keys of one host share their first 32-40 bytes.
+std::string MakeUrl(std::uint64_t key) {
+    static constexpr std::array<const char*, 8> kDomains{
+        "example.com", "example.org", "shop.example.net", "cdn.example.io",
+        "news.example.com", "api.example.org", "static.example.net", "blog.example.io"};
+    std::string url = "https://www.";
+    url += std::to_string(key % 32);
+    url += '.';
+    url += kDomains[(key >> 5) % kDomains.size()];
+    url += "/items/";
+    url += std::to_string(Mix(key) % 1'000'000'000);
+    return url;
+}
+
+/// `MakeSymbol` returns an OCC option symbol: a root padded to 6 characters, an expiration date,
+/// the type and the strike price. Options of one root and date share their first 13 bytes.
+std::string MakeSymbol(std::uint64_t key) {
+    static constexpr std::array<const char*, 16> kRoots{
+        "AAPL", "MSFT", "AMZN", "GOOGL", "META", "NVDA", "TSLA", "SPY",
+        "QQQ", "IWM", "AMD", "NFLX", "BAC", "XOM", "JPM", "DIS"};
+    char symbol[32];
+    const std::uint64_t bits = Mix(key);
+    std::snprintf(symbol, sizeof(symbol), "%-6s%02u%02u%02u%c%08u", kRoots[key % kRoots.size()],
+                  static_cast<unsigned>(24 + bits % 3), static_cast<unsigned>(1 + bits / 3 % 12),
+                  static_cast<unsigned>(1 + bits / 36 % 28), bits / 1'008 % 2 ? 'C' : 'P',
+                  static_cast<unsigned>(bits / 2'016 % 100'000'000));
+    return symbol;
+}
+
+enum class KeyShape { Sequential, Random, Zipfian };
+
+/// `Workload` holds the elements to insert, probe and erase, generated before any measurement.
+template <typename E>
+struct Workload {
+    std::vector<E> m_inserts;
+    std::vector<E> m_probes;
+    std::vector<E> m_sortedProbes;
+    std::vector<E> m_clusteredProbes;  // runs of near keys starting at random places
+    std::vector<E> m_erases;
+    std::size_t m_distinct = 0;  // number of different inserted elements
+};
+
+template <typename E>
+Workload<E> MakeWorkload(KeyShape shape,
+                         std::size_t size,
+                         std::uint64_t seed,
+                         E (*makeElement)(std::uint64_t) = MakeElement<E>) {
+    std::mt19937_64 generator{seed};
+    std::vector<std::uint64_t> keys(size);
+
+    switch (shape) {
+        case KeyShape::Sequential:
+            std::iota(keys.begin(), keys.end(), std::uint64_t{0});
+            break;
+        case KeyShape::Random:
+            for (auto& key : keys) {
+                key = generator();
+            }
+            break;
+        case KeyShape::Zipfian: {
+            ZipfGenerator zipf{size, 0.99};
+            for (auto& key : keys) {
+                key = Mix(zipf(generator));
+            }
+            break;
+        }
+    }
+
+    Workload<E> workload{};
+    workload.m_inserts.reserve(size);
+    for (auto key : keys) {
+        workload.m_inserts.push_back(makeElement(key));
+    }
+
+    if (shape == KeyShape::Zipfian) {
+        // probes follow the same skewed distribution as the inserts
+        ZipfGenerator zipf{size, 0.99};
+        for (std::size_t i = 0; i < size; ++i) {
+            workload.m_probes.push_back(makeElement(Mix(zipf(generator))));
+        }
+    } else {
+        workload.m_probes = workload.m_inserts;
+        if (shape == KeyShape::Random) {
+            std::shuffle(workload.m_probes.begin(), workload.m_probes.end(), generator);
+        }
+    }
+
+    workload.m_sortedProbes = workload.m_probes;
+    std::sort(workload.m_sortedProbes.begin(), workload.m_sortedProbes.end());
+
+    // every run of 16 probes hits a window of 64 neighbouring elements in a random order
+    constexpr std::size_t kClusterSize = 16;
+    constexpr std::size_t kClusterWindow = 64;
+    const std::size_t clusterStarts = size > kClusterWindow ? size - kClusterWindow : 1;
+    while (workload.m_clusteredProbes.size() < size) {
+        const std::size_t start = generator() % clusterStarts;
+        for (std::size_t i = 0; i < kClusterSize && workload.m_clusteredProbes.size() < size; ++i) {
+            const std::size_t index = std::min(size - 1, start + generator() % kClusterWindow);
+            workload.m_clusteredProbes.push_back(workload.m_sortedProbes[index]);
+        }
+    }
+
+    workload.m_erases = workload.m_inserts;
+    if (shape != KeyShape::Sequential) {
+        std::shuffle(workload.m_erases.begin(), workload.m_erases.end(), generator);
+    }
+
+    std::sort(keys.begin(), keys.end());
+    workload.m_distinct =
+        static_cast<std::size_t>(std::unique(keys.begin(), keys.end()) - keys.begin());
+
+    return workload;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Containers under test. Each adapter provides Insert, Find, Erase and Clear. An adapter with
+// `Seek` uses it for local lookups instead of `Find`.
+
+template <typename E>
+class AdsRbTree {
+public:
+    static constexpr const char* kName = "ads::RbTree";
+
+    void Insert(const E& val) { m_tree.Insert(val); }
+    bool Find(const E& val) const { return m_tree.Find(val) != nullptr; }
+    bool Seek(const E& val) { return m_cursor.Seek(val) != nullptr; }
+    void Erase(const E& val) {
+        m_cursor.Reset();
+        m_tree.Remove(val);
+    }
+    void Clear() {
+        m_cursor.Reset();
+        m_tree.Clear();
+    }
+
+private:
+    ads::RbTree<E> m_tree;
+    typename ads::RbTree<E>::Cursor m_cursor{m_tree};
+};
+
+/// `ThreeWayBytes` orders keys like `std::compare_three_way`, but `RbTree` doesn't recognize it
+/// and keeps no key prefixes in nodes.
+struct ThreeWayBytes {
+    template <typename T>
+    auto operator()(const T& lhs, const T& rhs) const {
+        return lhs <=> rhs;
+    }
+};
+
+template <typename E>
+class AdsRbTreeNoPrefix {
+public:
+    static constexpr const char* kName = "ads::RbTree noprefix";
+
+    void Insert(const E& val) { m_tree.Insert(val); }
+    bool Find(const E& val) const { return m_tree.Find(val) != nullptr; }
+    bool Seek(const E& val) { return m_cursor.Seek(val) != nullptr; }
+    void Erase(const E& val) {
+        m_cursor.Reset();
+        m_tree.Remove(val);
+    }
+    void Clear() {
+        m_cursor.Reset();
+        m_tree.Clear();
+    }
+
+private:
+    ads::RbTree<E, ThreeWayBytes> m_tree;
+    typename ads::RbTree<E, ThreeWayBytes>::Cursor m_cursor{m_tree};
+};
+
+/// `AdsSplitRbTree` keeps large values in a slab out of the nodes. `Find` reads the found value, so
+/// the extra indirection is part of the measured lookup.
+template <typename E>
+class AdsSplitRbTree {
+public:
+    static constexpr const char* kName = "ads::SplitRbTree";
+
+    void Insert(const E& val) { m_tree.TryEmplace(val.m_key, val); }
+    bool Find(const E& val) const {
+        const E* pValue = m_tree.Find(val.m_key);
+        return pValue && pValue->m_payload[0] == val.m_payload[0];
+    }
+    void Erase(const E& val) { m_tree.Remove(val.m_key); }
+    void Clear() { m_tree.Clear(); }
+
+private:
+    ads::SplitRbTree<std::uint64_t, E> m_tree;
+};
+
+template <typename E>
+class AdsTopDownRbTree {
+public:
+    static constexpr const char* kName = "ads::TopDownRbTree";
+
+    void Insert(const E& val) { m_tree.Insert(val); }
+    bool Find(const E& val) const { return m_tree.Find(val) != nullptr; }
+    void Erase(const E& val) { m_tree.Remove(val); }
+    void Clear() { m_tree.Clear(); }
+
+private:
+    ads::TopDownRbTree<E> m_tree;
+};
+
+template <typename E>
+class StdSet {
+public:
+    static constexpr const char* kName = "std::set";
+
+    void Insert(const E& val) { m_set.insert(val); }
+    bool Find(const E& val) const { return m_set.find(val) != m_set.end(); }
+    void Erase(const E& val) { m_set.erase(val); }
+    void Clear() { m_set.clear(); }
+
+private:
+    std::set<E> m_set;
+};
+
+template <typename E>
+class StdMap {
+public:
+    static constexpr const char* kName = "std::map";
+
+    void Insert(const E& val) { m_map.emplace(val, std::uint64_t{0}); }
+    bool Find(const E& val) const { return m_map.find(val) != m_map.end(); }
+    void Erase(const E& val) { m_map.erase(val); }
+    void Clear() { m_map.clear(); }
+
+private:
+    std::map<E, std::uint64_t> m_map;
+};
+
+/// `SortedVector` keeps elements in a sorted array. Updates are O(n), so they are measured only
+/// up to `kMaxUpdateSize` elements.
+template <typename E>
+class SortedVector {
+public:
+    static constexpr const char* kName = "sorted std::vector";
+    static constexpr std::size_t kMaxUpdateSize = 10'000;
+
+    void Insert(const E& val) {
+        auto it = std::lower_bound(m_vector.begin(), m_vector.end(), val);
+        if (it == m_vector.end() || val < *it) {
+            m_vector.insert(it, val);
+        }
+    }
+    bool Find(const E& val) const {
+        return std::binary_search(m_vector.begin(), m_vector.end(), val);
+    }
+    void Erase(const E& val) {
+        auto it = std::lower_bound(m_vector.begin(), m_vector.end(), val);
+        if (it != m_vector.end() && !(val < *it)) {
+            m_vector.erase(it);
+        }
+    }
+    void Clear() { m_vector.clear(); }
+
+    /// `Build` fills the array in O(n log n) when updates are not measured.
+    void Build(const std::vector<E>& values) {
+        m_vector = values;
+        std::sort(m_vector.begin(), m_vector.end());
+        m_vector.erase(std::unique(m_vector.begin(), m_vector.end()), m_vector.end());
+    }
+
+private:
+    std::vector<E> m_vector;
+};
+
+template <typename E>
+struct HashOf {
+    using type = std::hash<E>;
+};
+
+template <>
+struct HashOf<LargeValue> {
+    using type = LargeValueHash;
+};
+
+template <typename E>
+class StdUnorderedSet {
+public:
+    static constexpr const char* kName = "std::unordered_set";
+
+    void Insert(const E& val) { m_set.insert(val); }
+    bool Find(const E& val) const { return m_set.find(val) != m_set.end(); }
+    void Erase(const E& val) { m_set.erase(val); }
+    void Clear() { m_set.clear(); }
+
+private:
+    std::unordered_set<E, typename HashOf<E>::type> m_set;
+};
+
+template <typename C, typename = void>
+struct MaxUpdateSize {
+    static constexpr std::size_t value = SIZE_MAX;
+};
+
+template <typename C>
+struct MaxUpdateSize<C, std::void_t<decltype(C::kMaxUpdateSize)>> {
+    static constexpr std::size_t value = C::kMaxUpdateSize;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Measurement
+
+struct Options {
+    std::vector<std::size_t> m_sizes{1'000, 10'000, 100'000};
+    std::size_t m_repeats = 5;
+    std::size_t m_batch = 64;
+    std::vector<std::string> m_workloads{};  // empty means all
+    std::string m_jsonPath{};
+    bool m_counters = true;
+};
+
+/// `Result` describes one measured phase: per-operation latency is sampled over batches of
+/// `Options::m_batch` operations, which keeps the clock overhead out of the numbers. Hardware
+/// events are counted over whole measured runs and divided by the number of operations.
+struct Result {
+    std::string m_workload;
+    std::string m_container;
+    std::string m_phase;
+    std::size_t m_size = 0;
+    std::size_t m_ops = 0;
+    double m_meanNs = 0.0;
+    double m_p50Ns = 0.0;
+    double m_p99Ns = 0.0;
+    ads::PerfSample m_eventsPerOp{};
+    std::optional<double> m_bytesPerElement{};
+};
+
+class Reporter {
+public:
+    void Add(Result result) {
+        std::printf("%-12s %-20s %-8s %10zu %10.1f %10.1f %10.1f", result.m_workload.c_str(),
+                    result.m_container.c_str(), result.m_phase.c_str(), result.m_size,
+                    result.m_meanNs, result.m_p50Ns, result.m_p99Ns);
+        if (result.m_bytesPerElement) {
+            std::printf(" %10.1f", *result.m_bytesPerElement);
+        } else {
+            std::printf(" %10s", "-");
+        }
+        for (const auto& events : result.m_eventsPerOp) {
+            if (events) {
+                std::printf(" %10.2f", *events);
+            } else {
+                std::printf(" %10s", "-");
+            }
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+        m_results.push_back(std::move(result));
+    }
+
+    void PrintHeader() const {
+        std::printf("%-12s %-20s %-8s %10s %10s %10s %10s %10s", "workload", "container",
+                    "phase", "size", "mean ns", "p50 ns", "p99 ns", "B/elem");
+        for (const char* name : {"cycles", "instrs", "l1d miss", "llc miss", "dtlb miss",
+                                 "br miss"}) {
+            std::printf(" %10s", name);
+        }
+        std::printf("\n");
+    }
+
+    void WriteJson(const std::string& path) const {
+        std::ofstream out{path};
+        out << "[\n";
+        for (std::size_t i = 0; i < m_results.size(); ++i) {
+            const Result& result = m_results[i];
+            out << "  {\"workload\": \"" << result.m_workload << "\", \"container\": \""
+                << result.m_container << "\", \"phase\": \"" << result.m_phase
+                << "\", \"size\": " << result.m_size << ", \"ops\": " << result.m_ops
+                << ", \"mean_ns\": " << result.m_meanNs << ", \"p50_ns\": " << result.m_p50Ns
+                << ", \"p99_ns\": " << result.m_p99Ns << ", \"bytes_per_element\": ";
+            if (result.m_bytesPerElement) {
+                out << *result.m_bytesPerElement;
+            } else {
+                out << "null";
+            }
+            for (std::size_t event = 0; event < ads::kPerfCounterCount; ++event) {
+                out << ", \"" << ads::kPerfCounterNames[event] << "_per_op\": ";
+                if (result.m_eventsPerOp[event]) {
+                    out << *result.m_eventsPerOp[event];
+                } else {
+                    out << "null";
+                }
+            }
+            out << "}" << (i + 1 < m_results.size() ? "," : "") << "\n";
+        }
+        out << "]\n";
+    }
+
+private:
+    std::vector<Result> m_results;
+};
+
+/// `Counters` returns hardware counters shared by all phases.
+ads::PerfCounters& Counters() {
+    static ads::PerfCounters counters{};
+    return counters;
+}
+
+/// `MeasurePhase` runs `op(i)` for i in [0, ops) once as a warmup and then `repeats` times.
+/// `setup()` prepares the container before every run and is not measured.
+template <typename Setup, typename Op>
+Result MeasurePhase(const Options& options, std::size_t ops, Setup&& setup, Op&& op) {
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<double> samples{};
+    double totalNs = 0.0;
+    ads::PerfSample events{};
+    std::array<std::size_t, ads::kPerfCounterCount> countedRuns{};  // runs, in which an event ran
+
+    for (std::size_t run = 0; run <= options.m_repeats; ++run) {
+        setup();
+
+        const bool isWarmup = run == 0;
+        const bool countEvents = options.m_counters && !isWarmup;
+        if (countEvents) {
+            Counters().Start();
+        }
+        for (std::size_t begin = 0; begin < ops; begin += options.m_batch) {
+            const std::size_t end = std::min(ops, begin + options.m_batch);
+
+            const auto start = Clock::now();
+            for (std::size_t i = begin; i < end; ++i) {
+                op(i);
+            }
+            const auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start);
+
+            if (!isWarmup) {
+                totalNs += elapsed.count();
+                samples.push_back(elapsed.count() / static_cast<double>(end - begin));
+            }
+        }
+
+        if (countEvents) {
+            ads::PerfSample runEvents{};
+            Counters().Stop(runEvents);
+            for (std::size_t event = 0; event < ads::kPerfCounterCount; ++event) {
+                if (runEvents[event]) {
+                    events[event] = events[event].value_or(0.0) + *runEvents[event];
+                    ++countedRuns[event];
+                }
+            }
+        }
+    }
+
+    Result result{};
+    result.m_ops = ops;
+    if (!samples.empty()) {
+        std::sort(samples.begin(), samples.end());
+        result.m_meanNs = totalNs / static_cast<double>(ops * options.m_repeats);
+        result.m_p50Ns = samples[samples.size() / 2];
+        result.m_p99Ns = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+    }
+    for (std::size_t event = 0; event < ads::kPerfCounterCount; ++event) {
+        if (events[event] && ops > 0) {
+            result.m_eventsPerOp[event] =
+                *events[event] / static_cast<double>(ops * countedRuns[event]);
+        }
+    }
+    return result;
+}
+
+/// `HeapInUse` returns the number of bytes allocated by malloc, if the C library can tell it.
+std::optional<std::size_t> HeapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return ::mallinfo2().uordblks;
+#else
+    return std::nullopt;
+#endif
+}
+
+/// `g_sink` keeps results of lookups alive.
+volatile std::size_t g_sink = 0;
+
+template <template <typename> class Container, typename E>
+void RunContainer(const Options& options,
+                  Reporter& reporter,
+                  const std::string& workloadName,
+                  const Workload<E>& workload) {
+    using C = Container<E>;
+    const std::size_t size = workload.m_inserts.size();
+    const bool measureUpdates = size <= MaxUpdateSize<C>::value;
+
+    std::optional<double> bytesPerElement{};
+    auto report = [&](const char* phase, Result result) {
+        result.m_workload = workloadName;
+        result.m_container = C::kName;
+        result.m_phase = phase;
+        result.m_size = size;
+        result.m_bytesPerElement = bytesPerElement;
+        reporter.Add(std::move(result));
+    };
+
+    auto fillInto = [&](C& target) {
+        target.Clear();
+        if constexpr (MaxUpdateSize<C>::value != SIZE_MAX) {
+            if (!measureUpdates) {
+                target.Build(workload.m_inserts);
+                return;
+            }
+        }
+        for (const auto& val : workload.m_inserts) {
+            target.Insert(val);
+        }
+    };
+
+    // heap growth of a fresh filled container includes node headers, padding and allocator
+    // overhead
+    if (workload.m_distinct > 0) {
+        const std::optional<std::size_t> before = HeapInUse();
+        C filled{};
+        fillInto(filled);
+        const std::optional<std::size_t> after = HeapInUse();
+        if (before && after && *after >= *before) {
+            bytesPerElement = static_cast<double>(*after - *before) /
+                              static_cast<double>(workload.m_distinct);
+        }
+    }
+
+    C container{};
+    auto fill = [&] { fillInto(container); };
+
+    if (measureUpdates) {
+        auto clear = [&] { container.Clear(); };
+        report("insert", MeasurePhase(options, size, clear, [&](std::size_t i) {
+                   container.Insert(workload.m_inserts[i]);
+               }));
+    }
+
+    fill();
+    report("find", MeasurePhase(options, size, [] {}, [&](std::size_t i) {
+               g_sink = g_sink + container.Find(workload.m_probes[i]);
+           }));
+
+    auto seek = [&](const E& val) {
+        if constexpr (requires { container.Seek(val); }) {
+            return container.Seek(val);
+        } else {
+            return container.Find(val);
+        }
+    };
+    report("sorted", MeasurePhase(options, size, [] {}, [&](std::size_t i) {
+               g_sink = g_sink + seek(workload.m_sortedProbes[i]);
+           }));
+    report("cluster", MeasurePhase(options, size, [] {}, [&](std::size_t i) {
+               g_sink = g_sink + seek(workload.m_clusteredProbes[i]);
+           }));
+
+    if (measureUpdates) {
+        report("erase", MeasurePhase(options, size, fill, [&](std::size_t i) {
+                   container.Erase(workload.m_erases[i]);
+               }));
+    }
+}
+
+template <typename E>
+void RunWorkload(const Options& options,
+                 Reporter& reporter,
+                 const std::string& name,
+                 KeyShape shape) {
+    for (std::size_t size : options.m_sizes) {
+        const Workload<E> workload = MakeWorkload<E>(shape, size, size);
+
+        RunContainer<AdsRbTree>(options, reporter, name, workload);
+        if constexpr (std::is_same_v<E, LargeValue>) {
+            RunContainer<AdsSplitRbTree>(options, reporter, name, workload);
+        }
+        RunContainer<AdsTopDownRbTree>(options, reporter, name, workload);
+        RunContainer<StdSet>(options, reporter, name, workload);
+        RunContainer<StdMap>(options, reporter, name, workload);
+        RunContainer<SortedVector>(options, reporter, name, workload);
+        RunContainer<StdUnorderedSet>(options, reporter, name, workload);
+    }
+}
+
+/// `RunKeyFormat` compares string trees on keys with long common prefixes, which are
+/// decided by cached prefixes of nodes only partially.
+void RunKeyFormat(const Options& options,
+                  Reporter& reporter,
+                  const std::string& name,
+                  std::string (*makeKey)(std::uint64_t)) {
+    for (std::size_t size : options.m_sizes) {
+        const Workload<std::string> workload =
+            MakeWorkload<std::string>(KeyShape::Random, size, size, makeKey);
+
+        RunContainer<AdsRbTree>(options, reporter, name, workload);
+        RunContainer<AdsRbTreeNoPrefix>(options, reporter, name, workload);
+        RunContainer<StdSet>(options, reporter, name, workload);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Timer queues. Each adapter provides Push, Top, Pop and Clear, the earliest deadline is on top.
+
+class AdsTimerQueue {
+public:
+    static constexpr const char* kName = "ads::RbTree";
+
+    void Push(std::uint64_t key) { m_tree.Insert(key); }
+    std::uint64_t Top() const { return m_tree.Min()->m_value; }
+    void Pop() { m_tree.PopMin(); }
+    void Clear() { m_tree.Clear(); }
+
+private:
+    ads::RbTree<std::uint64_t> m_tree;
+};
+
+class StdSetTimerQueue {
+public:
+    static constexpr const char* kName = "std::set";
+
+    void Push(std::uint64_t key) { m_set.insert(key); }
+    std::uint64_t Top() const { return *m_set.begin(); }
+    void Pop() { m_set.erase(m_set.begin()); }
+    void Clear() { m_set.clear(); }
+
+private:
+    std::set<std::uint64_t> m_set;
+};
+
+class StdPriorityQueue {
+public:
+    static constexpr const char* kName = "std::priority_queue";
+
+    void Push(std::uint64_t key) { m_heap.push(key); }
+    std::uint64_t Top() const { return m_heap.top(); }
+    void Pop() { m_heap.pop(); }
+    void Clear() { m_heap = {}; }
+
+private:
+    std::priority_queue<std::uint64_t, std::vector<std::uint64_t>, std::greater<>> m_heap;
+};
+
+/// `kTimerIdBits` low bits of a timer key hold a sequence number, so equal deadlines stay
+/// distinct keys. A run of `size` timers uses `2 * size` numbers, 28 bits cover sizes up to 1e8
+/// and leave 36 bits for deadlines of at most `16 * size`.
+constexpr unsigned kTimerIdBits = 28;
+constexpr std::uint64_t kTimerIdMask = (std::uint64_t{1} << kTimerIdBits) - 1;
+
+/// `TimerWorkload` holds initial timers and the delay of a timer rearmed after each expiry.
+struct TimerWorkload {
+    std::vector<std::uint64_t> m_timers;
+    std::vector<std::uint64_t> m_delays;
+};
+
+TimerWorkload MakeTimerWorkload(std::size_t size, std::uint64_t seed) {
+    std::mt19937_64 generator{seed};
+    std::uniform_int_distribution<std::uint64_t> delay{1, 8 * size};
+
+    TimerWorkload workload{};
+    for (std::size_t i = 0; i < size; ++i) {
+        workload.m_timers.push_back(delay(generator) << kTimerIdBits | (i & kTimerIdMask));
+        workload.m_delays.push_back(delay(generator));
+    }
+    return workload;
+}
+
+/// `RunTimerQueue` measures a steady state of a timer queue: the earliest timer expires and is
+/// rearmed with a later deadline.
+template <typename Q>
+void RunTimerQueue(const Options& options, Reporter& reporter, const TimerWorkload& workload) {
+    const std::size_t size = workload.m_timers.size();
+
+    Q queue{};
+    auto fill = [&] {
+        queue.Clear();
+        for (const auto key : workload.m_timers) {
+            queue.Push(key);
+        }
+    };
+
+    Result result = MeasurePhase(options, size, fill, [&](std::size_t i) {
+        const std::uint64_t expired = queue.Top();
+        queue.Pop();
+        const std::uint64_t deadline = (expired >> kTimerIdBits) + workload.m_delays[i];
+        queue.Push(deadline << kTimerIdBits | ((size + i) & kTimerIdMask));
+    });
+    result.m_workload = "timers";
+    result.m_container = Q::kName;
+    result.m_phase = "pop+push";
+    result.m_size = size;
+    reporter.Add(std::move(result));
+}
+
+void RunTimerQueues(const Options& options, Reporter& reporter) {
+    for (std::size_t size : options.m_sizes) {
+        if (2 * size > kTimerIdMask + 1) {
+            // wrapped numbers would make equal keys, which only the set-based queues deduplicate
+            std::cerr << "timers: size " << size << " is skipped, timer ids have " << kTimerIdBits
+                      << " bits" << std::endl;
+            continue;
+        }
+        const TimerWorkload workload = MakeTimerWorkload(size, size);
+
+        RunTimerQueue<AdsTimerQueue>(options, reporter, workload);
+        RunTimerQueue<StdSetTimerQueue>(options, reporter, workload);
+        RunTimerQueue<StdPriorityQueue>(options, reporter, workload);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Ingest of random keys. Each adapter provides Insert, Find, Flush and Clear.
+
+class AdsIngest {
+public:
+    explicit AdsIngest(std::size_t) {}
+
+    void Insert(std::uint64_t key) { m_tree.InsertOrUpdate(key); }
+    bool Find(std::uint64_t key) const { return m_tree.Find(key) != nullptr; }
+    void Flush() {}
+    void Clear() { m_tree.Clear(); }
+
+private:
+    ads::RbTree<std::uint64_t> m_tree;
+};
+
+class BufferedIngest {
+public:
+    explicit BufferedIngest(std::size_t capacity) : m_tree{capacity} {}
+
+    void Insert(std::uint64_t key) { m_tree.InsertOrUpdate(key); }
+    bool Find(std::uint64_t key) const { return m_tree.Find(key) != nullptr; }
+    void Flush() { m_tree.Flush(); }
+    void Clear() { m_tree.Clear(); }
+
+private:
+    ads::BufferedRbTree<std::uint64_t> m_tree;
+};
+
+/// `RunIngest` measures inserts of random keys into an empty container, the last one is followed
+/// by a flush, and then lookups of inserted keys while the buffer is half full. Lookups scan the
+/// buffer, so at most `kIngestFinds` of them are measured.
+template <typename I>
+void RunIngest(const Options& options,
+               Reporter& reporter,
+               const std::string& name,
+               std::size_t capacity,
+               const std::vector<std::uint64_t>& keys) {
+    const std::size_t size = keys.size();
+
+    I container{capacity};
+    auto report = [&](const char* phase, Result result) {
+        result.m_workload = "ingest";
+        result.m_container = name;
+        result.m_phase = phase;
+        result.m_size = size;
+        reporter.Add(std::move(result));
+    };
+
+    report("insert", MeasurePhase(options, size, [&] { container.Clear(); }, [&](std::size_t i) {
+               container.Insert(keys[i]);
+               if (i + 1 == size) {
+                   container.Flush();
+               }
+           }));
+
+    for (std::size_t i = 0; i < capacity / 2; ++i) {
+        container.Insert(~keys[i]);
+    }
+    constexpr std::size_t kIngestFinds = 10'000;
+    report("find", MeasurePhase(options, std::min(size, kIngestFinds), [] {}, [&](std::size_t i) {
+               g_sink = g_sink + container.Find(keys[size - 1 - i]);
+           }));
+}
+
+void RunIngests(const Options& options, Reporter& reporter) {
+    for (std::size_t size : options.m_sizes) {
+        std::mt19937_64 generator{size};
+        std::vector<std::uint64_t> keys(size);
+        for (auto& key : keys) {
+            key = generator();
+        }
+
+        RunIngest<AdsIngest>(options, reporter, "ads::RbTree", 0, keys);
+        for (std::size_t capacity : {256, 4'096, 65'536}) {
+            RunIngest<BufferedIngest>(options, reporter,
+                                      "Buffered/" + std::to_string(capacity), capacity, keys);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Relocation of nodes by `Compact`
+
+using RelocatableTree = ads::RbTree<std::uint64_t,
+                                    std::less<std::uint64_t>,
+                                    ads::NoStats,
+                                    0,
+                                    ads::EagerRemove,
+                                    ads::ParentSteps,
+                                    ads::RelocatableNodes>;
+
+/// `RunRelocation` measures random lookups and an in-order scan of a tree, which nodes are
+/// scattered over the heap by churn: `size` removals of random keys interleaved with `size`
+/// insertions into a tree of `size` keys. Then the same tree is relinked or relocated by `Compact`
+/// and measured again. Every layout uses a tree with `RelocatableNodes`, so the churned and
+/// relinked trees pay for the same arena checks as the relocated ones.
+void RunRelocation(const Options& options,
+                   Reporter& reporter,
+                   const std::string& layout,
+                   std::size_t size,
+                   const std::function<void(RelocatableTree&)>& compact) {
+    std::mt19937_64 generator{size};
+    std::vector<std::uint64_t> keys(size);
+    for (auto& key : keys) {
+        key = generator();
+    }
+
+    RelocatableTree tree{};
+    for (const std::uint64_t key : keys) {
+        tree.Insert(key);
+    }
+    for (std::size_t i = 0; i < size; ++i) {
+        std::uint64_t& key = keys[generator() % size];
+        tree.Remove(key);
+        key = generator();
+        tree.Insert(key);
+    }
+    compact(tree);
+    std::shuffle(keys.begin(), keys.end(), generator);
+
+    auto report = [&](const char* phase, Result result) {
+        result.m_workload = "relocate";
+        result.m_container = layout;
+        result.m_phase = phase;
+        result.m_size = size;
+        reporter.Add(std::move(result));
+    };
+
+    report("find", MeasurePhase(options, size, [] {}, [&](std::size_t i) {
+               g_sink = g_sink + (tree.Find(keys[i]) != nullptr);
+           }));
+
+    auto it = tree.begin();
+    report("scan", MeasurePhase(options, tree.Size(), [&] { it = tree.begin(); }, [&](std::size_t) {
+               g_sink = g_sink + *it;
+               ++it;
+           }));
+}
+
+void RunRelocations(const Options& options, Reporter& reporter) {
+    using Tree = RelocatableTree;
+    for (std::size_t size : options.m_sizes) {
+        RunRelocation(options, reporter, "churned", size, [](Tree&) {});
+        RunRelocation(options, reporter, "relinked", size, [](Tree& tree) { tree.Compact(); });
+        RunRelocation(options, reporter, "bfs", size, [](Tree& tree) {
+            tree.Compact(ads::NodeOrder::BreadthFirst);
+        });
+        RunRelocation(options, reporter, "veb", size, [](Tree& tree) {
+            tree.Compact(ads::NodeOrder::VanEmdeBoas);
+        });
+        RunRelocation(options, reporter, "veb/hugepages", size, [](Tree& tree) {
+            tree.Compact(ads::NodeOrder::VanEmdeBoas, true);
+        });
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// In-order scans by iterators
+
+/// `RunScan` measures iterator steps over a tree of `size` random keys: a full scan from `begin`
+/// to `end` and range scans of `kRangeLength` steps from `LowerBound` of a random key. Every
+/// operation is one step, so a range scan includes its share of the lookup. Keys are inserted in
+/// order, so neighbours are allocated one after another, or the tree is churned like in
+/// `RunRelocation`, so almost every step misses the cache.
+template <typename Tree>
+void RunScan(const Options& options,
+             Reporter& reporter,
+             const std::string& container,
+             std::size_t size,
+             bool churn) {
+    constexpr std::size_t kRangeLength = 64;
+
+    std::mt19937_64 generator{size};
+    std::vector<std::uint64_t> keys(size);
+    for (auto& key : keys) {
+        key = generator();
+    }
+
+    if (!churn) {
+        std::sort(keys.begin(), keys.end());
+    }
+
+    Tree tree{};
+    for (const std::uint64_t key : keys) {
+        tree.insert(key);
+    }
+    for (std::size_t i = 0; churn && i < size; ++i) {
+        std::uint64_t& key = keys[generator() % size];
+        tree.erase(key);
+        key = generator();
+        tree.insert(key);
+    }
+    std::shuffle(keys.begin(), keys.end(), generator);
+
+    auto report = [&](const char* phase, Result result) {
+        result.m_workload = churn ? "scan/churn" : "scan";
+        result.m_container = container;
+        result.m_phase = phase;
+        result.m_size = size;
+        reporter.Add(std::move(result));
+    };
+
+    auto it = tree.begin();
+    report("full", MeasurePhase(options, tree.size(), [&] { it = tree.begin(); }, [&](std::size_t) {
+               g_sink = g_sink + *it;
+               ++it;
+           }));
+
+    std::size_t range = 0;
+    report("range", MeasurePhase(options, size, [&] { range = 0; }, [&](std::size_t i) {
+               if (i % kRangeLength == 0) {
+                   it = tree.lower_bound(keys[range++]);
+               }
+               if (it != tree.end()) {
+                   g_sink = g_sink + *it;
+                   ++it;
+               }
+           }));
+}
+
+/// `ScanTree` gives `RbTree` the names of `std::set` used by `RunScan`.
+template <typename IterationPolicy>
+class ScanTree {
+public:
+    using Tree = ads::RbTree<std::uint64_t,
+                             std::less<std::uint64_t>,
+                             ads::NoStats,
+                             0,
+                             ads::EagerRemove,
+                             IterationPolicy>;
+
+    void insert(std::uint64_t key) { m_tree.Insert(key); }
+    void erase(std::uint64_t key) { m_tree.Remove(key); }
+    auto lower_bound(std::uint64_t key) const { return m_tree.LowerBound(key); }
+    auto begin() const { return m_tree.begin(); }
+    auto end() const { return m_tree.end(); }
+    std::size_t size() const { return m_tree.Size(); }
+
+private:
+    Tree m_tree;
+};
+
+void RunScans(const Options& options, Reporter& reporter) {
+    for (std::size_t size : options.m_sizes) {
+        for (const bool churn : {false, true}) {
+            RunScan<ScanTree<ads::ParentSteps>>(options, reporter, "ads::RbTree", size, churn);
+            RunScan<ScanTree<ads::InOrderThreads>>(
+                options, reporter, "ads::RbTree/threads", size, churn);
+            RunScan<std::set<std::uint64_t>>(options, reporter, "std::set", size, churn);
+        }
+    }
+}
+
+bool IsSelected(const Options& options, const std::string& workload) {
+    return options.m_workloads.empty() ||
+           std::find(options.m_workloads.begin(), options.m_workloads.end(), workload) !=
+               options.m_workloads.end();
+}
+
+std::vector<std::string> Split(const std::string& str) {
+    std::vector<std::string> parts{};
+    std::size_t begin = 0;
+    while (begin <= str.size()) {
+        const std::size_t end = std::min(str.find(',', begin), str.size());
+        parts.push_back(str.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return parts;
+}
+
+void PrintUsage() {
+    std::cout << "usage: rbtree_bench [options]\n"
+                 "  --sizes N,N,...       number of elements, default 1000,10000,100000\n"
+                 "  --max-size N          use powers of ten from 1e3 up to N\n"
+                 "  --repeats N           measured runs after the warmup, default 5\n"
+                 "  --batch N             operations per latency sample, default 64\n"
+                 "  --workloads W,W,...   sequential, random, zipfian, string, url, symbol,\n"
+                 "                        large, timers, ingest, relocate, scan\n"
+                 "  --json PATH           write results as JSON\n"
+                 "  --counters on|off     hardware counters per operation, default on\n";
+}
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--help" || i + 1 == argc) {
+            PrintUsage();
+            return false;
+        }
+
+        const std::string value = argv[++i];
+        if (arg == "--sizes") {
+            options.m_sizes.clear();
+            for (const auto& size : Split(value)) {
+                options.m_sizes.push_back(std::stoull(size));
+            }
+        } else if (arg == "--max-size") {
+            options.m_sizes.clear();
+            for (std::size_t size = 1'000; size <= std::stoull(value); size *= 10) {
+                options.m_sizes.push_back(size);
+            }
+        } else if (arg == "--repeats") {
+            options.m_repeats = std::stoull(value);
+        } else if (arg == "--batch") {
+            options.m_batch = std::max<std::size_t>(1, std::stoull(value));
+        } else if (arg == "--workloads") {
+            options.m_workloads = Split(value);
+        } else if (arg == "--json") {
+            options.m_jsonPath = value;
+        } else if (arg == "--counters") {
+            options.m_counters = value != "off";
+        } else {
+            PrintUsage();
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options{};
+    if (!ParseOptions(argc, argv, options)) {
+        return 1;
+    }
+
+    if (options.m_counters && !Counters().Available()) {
+        std::cerr << "hardware counters are unavailable, only timings are reported" << std::endl;
+        options.m_counters = false;
+    }
+
+    Reporter reporter{};
+    reporter.PrintHeader();
+
+    if (IsSelected(options, "sequential")) {
+        RunWorkload<std::uint64_t>(options, reporter, "sequential", KeyShape::Sequential);
+    }
+    if (IsSelected(options, "random")) {
+        RunWorkload<std::uint64_t>(options, reporter, "random", KeyShape::Random);
+    }
+    if (IsSelected(options, "zipfian")) {
+        RunWorkload<std::uint64_t>(options, reporter, "zipfian", KeyShape::Zipfian);
+    }
+    if (IsSelected(options, "string")) {
+        RunWorkload<std::string>(options, reporter, "string", KeyShape::Random);
+    }
+    if (IsSelected(options, "url")) {
+        RunKeyFormat(options, reporter, "url", MakeUrl);
+    }
+    if (IsSelected(options, "symbol")) {
+        RunKeyFormat(options, reporter, "symbol", MakeSymbol);
+    }
+    if (IsSelected(options, "large")) {
+        RunWorkload<LargeValue>(options, reporter, "large", KeyShape::Random);
+    }
+    if (IsSelected(options, "timers")) {
+        RunTimerQueues(options, reporter);
+    }
+    if (IsSelected(options, "ingest")) {
+        RunIngests(options, reporter);
+    }
+    if (IsSelected(options, "relocate")) {
+        RunRelocations(options, reporter);
+    }
+    if (IsSelected(options, "scan")) {
+        RunScans(options, reporter);
+    }
+
+    if (!options.m_jsonPath.empty()) {
+        reporter.WriteJson(options.m_jsonPath);
+    }
+}
@@ -0,0 +1,25 @@
+// Hot paths of the tree compiled out of line, so `make codesize` can report their machine code
+// size with `nm`. Nothing here is ever called.
+
+#include <cstdint>
+
+#include "RbTree.hpp"
+
+using Tree = ads::RbTree<std::uint64_t>;
+
+__attribute__((noinline)) bool CodeSizeFind(const Tree& tree, std::uint64_t key) {
+    return tree.Find(key) != nullptr;
+}
+
+__attribute__((noinline)) void CodeSizeInsert(Tree& tree, std::uint64_t val) {
+    tree.Insert(val);
+}
+
+__attribute__((noinline)) void CodeSizeRemove(Tree& tree, std::uint64_t key) {
+    tree.Remove(key);
+}
+
+namespace ads::internal {
+template bool RebalanceAfterInsert<NoStats>(TreeHeader&, NodeBase*);
+template void RebalanceAfterRemove<NoStats>(TreeHeader&, NodeBase*, NodeBase*);
+}  // namespace ads::internal
@@ -1,112 +1,1077 @@
-#include <array>
-#include <chrono>
-#include <iostream>
-#include <set>
-#include <string>
-
-#include "RbTree.hpp"
-
-/// Class `Timer` is used for measuring performance of a code block.
-/// It fix a `time_point` of instantiation and destruction and prints
-/// execution time of a code block in milliseconds.
-class Stopwatch {
-public:
-    Stopwatch(const std::string& messagePrefix)
-        : m_start{std::chrono::high_resolution_clock::now()}, m_messagePrefix{messagePrefix} {}
-
-    ~Stopwatch() {
-        auto end = std::chrono::high_resolution_clock::now();
-        auto executionTime = end - m_start;
-        std::cout << m_messagePrefix << "Execution time: "
-                  << std::chrono::duration_cast<std::chrono::nanoseconds>(executionTime).count()
-                  << " ns" << std::endl;
-    }
-
-private:
-    std::chrono::high_resolution_clock::time_point m_start;
-    std::string m_messagePrefix;
-};
-
-static void CheckRbTreeInsert() {
-    // values to insert
-    std::array<int, 10> values{10, 12, 5, 7, 0, 14, 20, 8, 9, 1};
-    ads::RbTree<int> set{};
-
-    std::size_t idx = 0;
-    for (const auto& entry : values) {
-        set.Insert(entry);
-        std::cout << "\nIdx " << (idx++) << ":" << std::endl;
-        set.Dump();
-    }
-    set.Dump();
-}
-
-static void CheckRbTreeDelete() {
-    std::cout << "\nChecking deleting" << std::endl;
-
-    // values to insert
-    std::array<int, 10> values{10, 12, 5, 7, 0, 14, 20, 8, 9, 1};
-    ads::RbTree<int> set{};
-
-    for (const auto& entry : values) {
-        set.Insert(entry);
-    }
-
-    std::size_t idx = 0;
-    for (const auto& entry : values) {
-        std::cout << "\nIdx " << (idx++) << ":"
-                  << ", value to delete " << entry << std::endl;
-        set.Remove(entry);
-        set.Dump();
-    }
-}
-
-int main() {
-    {
-        std::set<int> stdSet{};
-        ads::RbTree<int> adsSet{};
-
-        {
-            Stopwatch _{"Insertion in std::set    "};
-            for (int i = 0; i < 30'000; ++i) {
-                stdSet.insert(i);
-            }
-        }
-        {
-            Stopwatch _{"Insertion in ads::RbTree "};
-            for (int i = 0; i < 30'000; ++i) {
-                adsSet.Insert(i);
-            }
-        }
-        {
-            Stopwatch _{"Searching in std::set    "};
-            for (int i = 0; i < 30'000; ++i) {
-                stdSet.find(i);
-            }
-        }
-        {
-            Stopwatch _{"Searching in ads::RbTree "};
-            for (int i = 0; i < 30'000; ++i) {
-                adsSet.Find(i);
-            }
-        }
-        {
-            Stopwatch _{"Deleting in std::set     "};
-            for (int i = 0; i < 30'000; ++i) {
-                stdSet.erase(i);
-            }
-        }
-        {
-            Stopwatch _{"Deleting in ads::RbTree  "};
-            for (int i = 0; i < 30'000; ++i) {
-                adsSet.Remove(i);
-            }
-        }
-    }
-    {
-        CheckRbTreeInsert();
-    }
-    {
-        CheckRbTreeDelete();
-    }
-}
+#include <algorithm>
+#include <array>
+#include <compare>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <ios>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "BufferedRbTree.hpp"
+#include "IntervalTree.hpp"
+#include "IntrusiveRbTree.hpp"
+#include "PersistentRbTree.hpp"
+#include "RbMultiTree.hpp"
+#include "RbTree.hpp"
+#include "SplitRbTree.hpp"
+#include "StaticTree.hpp"
+#include "TopDownRbTree.hpp"
+
+/// `g_failures` counts failed expectations, `main` fails if there are any.
+static int g_failures = 0;
+
+static void Expect(bool condition, const char* expression, int line) {
+    if (!condition) {
+        std::cerr << "line " << line << ": expected " << expression << std::endl;
+        ++g_failures;
+    }
+}
+
+/// EXPECT reports `condition` if it doesn't hold, checks go on to report all failures at once.
+#define EXPECT(condition) Expect((condition), #condition, __LINE__)
+
+using ads::internal::Color;
+using ads::internal::kLeft;
+using ads::internal::kRight;
+using ads::internal::NodeBase;
+
+/// `CheckSubtree` returns the black height of the subtree of `pNode` and appends its nodes in
+/// order to `nodes`. `valid` turns false on a red node with a red child, a child which doesn't
+/// link back to its parent and on children with different black heights.
+static std::size_t CheckSubtree(const NodeBase* pNode,
+                                std::vector<const NodeBase*>& nodes,
+                                bool& valid) {
+    if (!pNode) {
+        return 1;
+    }
+
+    const bool isRed = pNode->m_color == Color::Red;
+    for (const NodeBase* pChild : pNode->m_child) {
+        if (pChild) {
+            valid = valid && pChild->m_pParent == pNode;
+            valid = valid && !(isRed && pChild->m_color == Color::Red);
+        }
+    }
+
+    const std::size_t leftHeight = CheckSubtree(pNode->m_child[kLeft], nodes, valid);
+    nodes.push_back(pNode);
+    const std::size_t rightHeight = CheckSubtree(pNode->m_child[kRight], nodes, valid);
+    valid = valid && leftHeight == rightHeight;
+    return leftHeight + !isRed;
+}
+
+/// `CheckRedBlack` checks the structure of `tree`, which comparisons of contents can't see: the
+/// root is black, red nodes have black children, all paths have the same black height, parent
+/// links match child links, the cached most left and right nodes are the extreme ones and threads
+/// of `InOrderThreads` link every node to its in-order neighbours.
+template <typename Tree>
+static bool CheckRedBlack(const Tree& tree) {
+    const NodeBase* pEnd = tree.end().Node();
+    const NodeBase* pRoot = pEnd->m_pParent;
+
+    bool valid = !pRoot || (pRoot->m_pParent == pEnd && pRoot->m_color == Color::Black);
+    std::vector<const NodeBase*> nodes{};
+    CheckSubtree(pRoot, nodes, valid);
+
+    const NodeBase* pFirst = nodes.empty() ? nullptr : nodes.front();
+    const NodeBase* pLast = nodes.empty() ? nullptr : nodes.back();
+    valid = valid && pEnd->m_child[kLeft] == pFirst && pEnd->m_child[kRight] == pLast;
+
+    // dead nodes of `LazyRemove` are linked, but not counted
+    const auto liveCount = std::count_if(nodes.begin(), nodes.end(),
+                                         [](const NodeBase* pNode) { return !pNode->m_isDead; });
+    valid = valid && static_cast<std::size_t>(liveCount) == tree.Size();
+
+    if constexpr (Tree::iteration_policy::kThreaded) {
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            const auto* pNode = static_cast<const typename Tree::NodeType*>(nodes[i]);
+            const NodeBase* pPrev = i > 0 ? nodes[i - 1] : pEnd;
+            const NodeBase* pNext = i + 1 < nodes.size() ? nodes[i + 1] : pEnd;
+            valid = valid && pNode->m_thread[kLeft] == pPrev && pNode->m_thread[kRight] == pNext;
+        }
+    }
+    return valid;
+}
+
+static void CheckRbTreeInsert() {
+    // values to insert
+    std::array<int, 10> values{10, 12, 5, 7, 0, 14, 20, 8, 9, 1};
+    ads::RbTree<int> set{};
+
+    std::size_t idx = 0;
+    for (const auto& entry : values) {
+        set.Insert(entry);
+        std::cout << "\nIdx " << (idx++) << ":" << std::endl;
+        set.Dump();
+    }
+    set.Dump();
+
+    std::sort(values.begin(), values.end());
+    EXPECT(set.Size() == values.size());
+    EXPECT(std::equal(set.begin(), set.end(), values.begin(), values.end()));
+}
+
+static void CheckRbTreeDelete() {
+    std::cout << "\nChecking deleting" << std::endl;
+
+    // values to insert
+    std::array<int, 10> values{10, 12, 5, 7, 0, 14, 20, 8, 9, 1};
+    ads::RbTree<int> set{};
+
+    for (const auto& entry : values) {
+        set.Insert(entry);
+    }
+
+    std::size_t idx = 0;
+    for (const auto& entry : values) {
+        std::cout << "\nIdx " << (idx++) << ":"
+                  << ", value to delete " << entry << std::endl;
+        set.Remove(entry);
+        set.Dump();
+        EXPECT(!set.Contains(entry));
+        EXPECT(set.Size() == values.size() - idx);
+        EXPECT(CheckRedBlack(set));
+    }
+    EXPECT(set.Empty());
+}
+
+static void CheckRbTreeSerialization() {
+    std::cout << "\nChecking serialization" << std::endl;
+
+    std::mt19937 generator{42};
+    ads::RbTree<int> set{};
+    for (int i = 0; i < 10'000; ++i) {
+        set.Insert(static_cast<int>(generator() % 100'000));
+    }
+
+    std::stringstream stream{};
+    set.Serialize(stream, 4096);
+
+    ads::RbTree<int> restored{};
+    restored.Deserialize(stream, 4096);
+
+    bool allFound = restored.Size() == set.Size();
+    generator.seed(42);
+    for (int i = 0; i < 10'000; ++i) {
+        allFound = allFound && restored.Contains(static_cast<int>(generator() % 100'000));
+    }
+    std::cout << "Restored " << restored.Size() << " of " << set.Size()
+              << " values, all found: " << allFound << std::endl;
+    EXPECT(allFound);
+    EXPECT(std::equal(restored.begin(), restored.end(), set.begin(), set.end()));
+    EXPECT(CheckRedBlack(restored));
+
+    ads::RbTree<std::string, std::less<std::string>> small{};
+    for (const char* word : {"delta", "alpha", "echo", "charlie", "bravo", "foxtrot"}) {
+        small.Insert(word);
+    }
+    std::stringstream smallStream{};
+    small.Serialize(smallStream, 0);
+    ads::RbTree<std::string, std::less<std::string>> smallRestored{};
+    smallRestored.Deserialize(smallStream, 0);
+    smallRestored.Dump();
+    EXPECT(std::equal(smallRestored.begin(), smallRestored.end(), small.begin(), small.end()));
+    EXPECT(CheckRedBlack(smallRestored));
+
+    // a corrupt length of a string must fail on the missing bytes, not allocate them
+    std::stringstream corruptStream{};
+    small.Serialize(corruptStream, 0);
+    std::string corrupt = corruptStream.str();
+    const std::uint64_t length = std::string_view{"alpha"}.size();
+    const std::uint64_t hugeLength = std::uint64_t{1} << 60;
+    const std::size_t lengthPos =
+        corrupt.find(std::string{reinterpret_cast<const char*>(&length), sizeof(length)} + "alpha");
+    corrupt.replace(lengthPos, sizeof(hugeLength),
+                    reinterpret_cast<const char*>(&hugeLength), sizeof(hugeLength));
+    corruptStream.str(corrupt);
+    bool rejected = false;
+    try {
+        smallRestored.Deserialize(corruptStream, 0);
+    } catch (const std::ios_base::failure&) {
+        rejected = true;
+    }
+    std::cout << "Corrupt string length rejected: " << rejected << std::endl;
+    EXPECT(rejected);
+}
+
+static void CheckRbTreeStats() {
+    std::cout << "\nChecking statistics" << std::endl;
+
+    using StatsTree = ads::RbTree<int, std::less<int>, ads::TreeStats<>>;
+    static_assert(sizeof(StatsTree) == sizeof(ads::RbTree<int>), "stats must not grow the tree");
+
+    std::mt19937 generator{7};
+    StatsTree set{};
+    set.ResetStats();
+    for (int i = 0; i < 10'000; ++i) {
+        set.Insert(static_cast<int>(generator() % 100'000));
+    }
+    for (int i = 0; i < 10'000; ++i) {
+        set.Find(i);
+    }
+    for (int i = 0; i < 10'000; i += 3) {
+        set.Remove(i);
+    }
+
+    const ads::TreeStatsSnapshot stats = set.Stats();
+    std::size_t maxFindDepth = 0;
+    for (std::size_t depth = 0; depth < stats.m_findDepth.size(); ++depth) {
+        if (stats.m_findDepth[depth] > 0) {
+            maxFindDepth = depth;
+        }
+    }
+    std::cout << "Rotations: " << stats.m_rotations << ", recolors: " << stats.m_recolors
+              << ", comparisons: " << stats.m_comparisons << ", max find depth: " << maxFindDepth
+              << std::endl;
+    std::cout << "Stats of a tree without policy are empty: "
+              << (ads::RbTree<int>{}.Stats().m_comparisons == 0) << std::endl;
+    EXPECT(stats.m_rotations > 0 && stats.m_recolors > 0 && stats.m_comparisons > 0);
+    // a red-black tree of n nodes is at most 2 log2(n + 1) high
+    EXPECT(maxFindDepth <= 2 * 14);
+    EXPECT(ads::RbTree<int>{}.Stats().m_comparisons == 0);
+}
+
+static void CheckRbTreeMemoryUsage() {
+    std::cout << "\nChecking memory usage" << std::endl;
+
+    ads::RbTree<std::string, std::less<std::string>, ads::NoStats, 8> set{};
+    for (int i = 0; i < 1'000; ++i) {
+        set.Insert(std::to_string(i) + std::string(i % 2 ? 40 : 0, 'x'));
+    }
+
+    const auto stringBytes = [](const std::string& str) {
+        return str.capacity() > std::string{}.capacity() ? str.capacity() + 1 : 0;
+    };
+    const ads::TreeMemoryUsage usage = set.MemoryUsage(stringBytes);
+    std::cout << "Nodes: " << usage.m_nodeCount << ", on heap: " << usage.m_heapNodeCount
+              << ", node size: " << usage.m_nodeSize << ", links: " << usage.m_linkSize
+              << ", owned by strings: " << usage.m_ownedBytes
+              << ", total covers nodes: " << (usage.Total() > 1'000 * usage.m_nodeSize)
+              << std::endl;
+    EXPECT(usage.m_nodeCount == 1'000);
+    EXPECT(usage.m_heapNodeCount == 1'000 - 8);
+    EXPECT(usage.m_ownedBytes > 500 * 40);
+    EXPECT(usage.Total() > 1'000 * usage.m_nodeSize);
+}
+
+static void CheckPersistentRbTree() {
+    std::cout << "\nChecking persistent tree" << std::endl;
+
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "ads_persistent_rbtree.bin").string();
+    std::remove(path.c_str());
+
+    bool capacityKept = true;
+    {
+        // a key which is already there must not grow the file, even when the next node would
+        ads::PersistentRbTree<std::pair<int, int>> tree{path, 4096};
+        tree.Insert({0, 0});
+        for (int i = 1; i < 1'000; ++i) {
+            const std::size_t capacity = tree.Capacity();
+            tree.Insert({0, 0});
+            tree.InsertOrUpdate({i / 2, i});
+            capacityKept = capacityKept && tree.Capacity() == capacity;
+            tree.Insert({i, i});
+        }
+    }
+    std::remove(path.c_str());
+
+    {
+        // small initial capacity to make the file grow a few times
+        ads::PersistentRbTree<std::pair<int, int>> tree{path, 4096};
+        for (int i = 0; i < 10'000; ++i) {
+            tree.Insert({i, i * i});
+        }
+        for (int i = 0; i < 10'000; i += 2) {
+            tree.Remove(i);
+        }
+        tree.Sync();
+    }
+
+    // a crash while the file grows leaves it larger than the header says
+    const std::uintmax_t fileSize = std::filesystem::file_size(path) * 2;
+    std::filesystem::resize_file(path, fileSize);
+
+    ads::PersistentRbTree<std::pair<int, int>> tree{path};
+    std::cout << "Size after reopen: " << tree.Size() << ", capacity: " << tree.Capacity()
+              << ", kept for existing keys: " << capacityKept << std::endl;
+    std::cout << "Contains 4: " << tree.Contains(4) << ", contains 99: " << tree.Contains(99)
+              << ", value of 99: " << tree.Find(99)->m_value.second << std::endl;
+    EXPECT(capacityKept);
+    EXPECT(tree.Capacity() == fileSize);
+    EXPECT(tree.Size() == 5'000);
+    EXPECT(!tree.Contains(4) && tree.Contains(99) && tree.Find(99)->m_value.second == 9'801);
+
+    std::remove(path.c_str());
+}
+
+static void CheckRbTreeThreeWayCompare() {
+    std::cout << "\nChecking three-way comparison" << std::endl;
+
+    ads::RbTree<std::string, std::compare_three_way> set{};
+    for (int i = 0; i < 1'000; ++i) {
+        set.Insert(std::to_string(i * 7 % 1'000));
+    }
+    for (int i = 0; i < 1'000; i += 2) {
+        set.Remove(std::to_string(i));
+    }
+
+    std::size_t found = 0;
+    for (int i = 0; i < 1'000; ++i) {
+        found += set.Contains(std::to_string(i));
+    }
+    std::cout << "Size: " << set.Size() << ", found: " << found << std::endl;
+    EXPECT(set.Size() == 500);
+    EXPECT(found == 500);
+}
+
+static void CheckRbTreeKeyPrefix() {
+    std::cout << "\nChecking cached key prefixes" << std::endl;
+
+    // keys share the first 16 bytes, are prefixes of each other or differ only by a zero byte
+    std::vector<std::string> keys{"", std::string(1, '\0'), "a", std::string("a\0", 2)};
+    std::mt19937 gen{7};
+    for (int i = 0; i < 2'000; ++i) {
+        std::string key = i % 3 ? "https://example.com/" : "sym";
+        key += std::to_string(gen() % 1'000);
+        keys.push_back(i % 5 ? key : key.substr(0, gen() % (key.size() + 1)));
+    }
+
+    ads::RbTree<std::string> set{};
+    std::set<std::string> expected{};
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        set.Insert(keys[i]);
+        expected.insert(keys[i]);
+        if (i % 4 == 3) {
+            set.Remove(keys[i / 2]);
+            expected.erase(keys[i / 2]);
+        }
+    }
+
+    std::size_t found = 0;
+    std::size_t mismatches = 0;
+    ads::RbTree<std::string>::Cursor cursor{set};
+    for (const std::string& key : keys) {
+        found += set.Contains(key);
+        mismatches += set.Contains(key) != expected.contains(key);
+        mismatches += (cursor.Seek(key) != nullptr) != expected.contains(key);
+    }
+    const bool sameOrder = std::equal(set.begin(), set.end(), expected.begin(), expected.end());
+    std::cout << "Size: " << set.Size() << ", found: " << found << ", mismatches: " << mismatches
+              << ", same order: " << sameOrder << std::endl;
+    EXPECT(set.Size() == expected.size());
+    EXPECT(mismatches == 0);
+    EXPECT(sameOrder);
+}
+
+static void CheckRbTreeInlineNodes() {
+    std::cout << "\nChecking inline nodes" << std::endl;
+
+    using SmallTree = ads::RbTree<int, std::less<int>, ads::NoStats, 8>;
+    std::cout << "Empty tree size: " << sizeof(ads::RbTree<int>)
+              << " bytes, with 8 inline nodes: " << sizeof(SmallTree) << " bytes" << std::endl;
+
+    SmallTree set{};
+    for (int i = 0; i < 20; ++i) {
+        set.Insert(i);
+    }
+    for (int i = 0; i < 20; i += 2) {
+        set.Remove(i);
+    }
+
+    SmallTree copy{set};
+    SmallTree moved{std::move(copy)};
+    copy = moved;
+    std::cout << "Sizes: " << set.Size() << " " << moved.Size() << " " << copy.Size()
+              << ", copies are equal: " << (set == moved && set == copy) << std::endl;
+    EXPECT(set.Size() == 10);
+    EXPECT(set == moved && set == copy);
+    EXPECT(CheckRedBlack(set) && CheckRedBlack(moved) && CheckRedBlack(copy));
+}
+
+struct Order : public ads::IntrusiveHook<> {
+    int m_id = 0;
+};
+
+struct OrderId {
+    int operator()(const Order& order) const noexcept { return order.m_id; }
+};
+
+static void CheckRbTreeMinMax() {
+    std::cout << "\nChecking min and max" << std::endl;
+
+    std::mt19937 generator{19};
+    ads::RbTree<int> queue{};
+    std::set<int> expected{};
+    bool matches = true;
+    for (int i = 0; i < 20'000; ++i) {
+        const int key = static_cast<int>(generator() % 10'000);
+        switch (generator() % 8) {
+            case 0:
+                queue.PopMin();
+                if (!expected.empty()) {
+                    expected.erase(expected.begin());
+                }
+                break;
+            case 1:
+                queue.PopMax();
+                if (!expected.empty()) {
+                    expected.erase(std::prev(expected.end()));
+                }
+                break;
+            case 2:
+                queue.Remove(key);
+                expected.erase(key);
+                break;
+            default:
+                queue.Insert(key);
+                expected.insert(key);
+        }
+        matches = matches && (expected.empty()
+                                  ? !queue.Min() && !queue.Max()
+                                  : queue.Min()->m_value == *expected.begin() &&
+                                        queue.Max()->m_value == *expected.rbegin());
+    }
+
+    std::cout << "Size: " << queue.Size() << ", min and max match std::set: " << matches
+              << std::endl;
+    EXPECT(queue.Size() == expected.size());
+    EXPECT(matches);
+    EXPECT(CheckRedBlack(queue));
+
+    // popping an empty tree does nothing
+    ads::RbTree<int> empty{};
+    empty.PopMin();
+    empty.PopMax();
+    EXPECT(empty.Empty() && !empty.Min() && !empty.Max());
+}
+
+static void CheckRbTreeErase() {
+    std::cout << "\nChecking erasing by node" << std::endl;
+
+    ads::RbTree<int> set{};
+    for (int i = 0; i < 1'000; ++i) {
+        set.Insert(i);
+    }
+
+    // erase every odd value while walking the tree
+    for (auto it = set.begin(); it != set.end();) {
+        it = *it % 2 == 1 ? set.Erase(it) : std::next(it);
+    }
+    const auto* pNext = set.Erase(set.Find(500));
+    const bool lastHasNoNext = set.Erase(set.Max()) == nullptr;
+
+    std::cout << "Size: " << set.Size() << ", next after 500: " << pNext->m_value
+              << ", last has no next: " << lastHasNoNext << ", max: " << set.Max()->m_value
+              << std::endl;
+    EXPECT(set.Size() == 498);
+    EXPECT(pNext->m_value == 502);
+    EXPECT(lastHasNoNext);
+    EXPECT(set.Max()->m_value == 996);
+    EXPECT(CheckRedBlack(set));
+    EXPECT(std::all_of(set.begin(), set.end(), [](int value) { return value % 2 == 0; }));
+}
+
+static void CheckRbTreeCursor() {
+    std::cout << "\nChecking cursor" << std::endl;
+
+    ads::RbTree<int> multiplesOf3{};
+    ads::RbTree<int> multiplesOf5{};
+    for (int i = 0; i < 3'000; ++i) {
+        multiplesOf3.Insert(i * 3);
+        multiplesOf5.Insert(i * 5);
+    }
+
+    // merge join: probes come in ascending order, so each one starts next to the previous
+    ads::RbTree<int>::Cursor cursor{multiplesOf5};
+    std::size_t common = 0;
+    for (const int value : multiplesOf3) {
+        common += cursor.Seek(value) != nullptr;
+    }
+
+    std::cout << "Common values: " << common << ", finger: " << cursor.Node()->m_value
+              << std::endl;
+    EXPECT(common == 600);
+    EXPECT(cursor.Node()->m_value == 9'000);
+
+    // a seek, which ends on a tombstone, leaves the finger on a live node, so a compaction
+    // triggered by other removals doesn't free it
+    ads::RbTree<int, std::less<int>, ads::NoStats, 0, ads::LazyRemove<50>> lazy{};
+    for (int i = 0; i < 100; ++i) {
+        lazy.Insert(i);
+    }
+    lazy.Remove(10);
+    decltype(lazy)::Cursor lazyCursor{lazy};
+    const bool deadIsNotFound = lazyCursor.Seek(10) == nullptr;
+    const bool fingerIsLive = lazyCursor.Node() && lazyCursor.Node()->m_value != 10;
+    for (int i = 20; i < 80; ++i) {
+        lazy.Remove(i);
+    }
+    const auto pEleven = lazyCursor.Seek(11);
+    std::cout << "Tombstone is not found: " << deadIsNotFound
+              << ", finger is live: " << fingerIsLive
+              << ", found after compaction: " << (pEleven && pEleven->m_value == 11) << std::endl;
+    EXPECT(deadIsNotFound);
+    EXPECT(fingerIsLive);
+    EXPECT(pEleven && pEleven->m_value == 11);
+    EXPECT(!lazyCursor.Seek(50) && lazyCursor.Seek(90) && lazyCursor.Node()->m_value == 90);
+}
+
+static void CheckRbTreeMap() {
+    std::cout << "\nChecking map interface" << std::endl;
+
+    ads::RbTree<std::pair<std::string, int>> counters{};
+    const std::array<std::string, 6> words{"b", "a", "c", "a", "b", "a"};
+    for (const auto& word : words) {
+        counters[word] += 1;
+    }
+    counters.Upsert("d", [](int& count) { count += 10; });
+    counters.Upsert("a", [](int& count) { count += 10; });
+    const bool inserted = counters.TryEmplace("c", 100).second;
+    counters.InsertOrAssign("b", 7);
+
+    bool threw = false;
+    try {
+        counters.At("e");
+    } catch (const std::out_of_range&) {
+        threw = true;
+    }
+
+    std::cout << "Size: " << counters.Size() << ", a: " << counters.At("a")
+              << ", b: " << counters.At("b") << ", c: " << counters.At("c")
+              << ", d: " << counters.At("d") << ", inserted c: " << inserted
+              << ", missing key throws: " << threw << std::endl;
+    EXPECT(counters.Size() == 4);
+    EXPECT(counters.At("a") == 13 && counters.At("b") == 7);
+    EXPECT(counters.At("c") == 1 && counters.At("d") == 10);
+    EXPECT(!inserted);
+    EXPECT(threw);
+}
+
+static void CheckRbTreeEraseRange() {
+    std::cout << "\nChecking range erasing" << std::endl;
+
+    ads::RbTree<int> set{};
+    std::set<int> expected{};
+    for (int i = 0; i < 10'000; ++i) {
+        set.Insert(i * 7 % 10'000);
+        expected.insert(i);
+    }
+
+    const auto erased = set.EraseRange(1'000, 4'000);
+    expected.erase(expected.lower_bound(1'000), expected.lower_bound(4'000));
+    auto extracted = set.ExtractRange(6'000, 6'500);
+    expected.erase(expected.lower_bound(6'000), expected.lower_bound(6'500));
+    set.EraseRange(std::next(set.begin(), 9'000 - 3'500), set.end());
+    expected.erase(expected.lower_bound(9'000), expected.end());
+
+    const bool matches = std::equal(set.begin(), set.end(), expected.begin(), expected.end());
+    std::cout << "Erased: " << erased << ", extracted: " << extracted.Size()
+              << ", size: " << set.Size() << ", matches std::set: " << matches << std::endl;
+    EXPECT(erased == 3'000);
+    EXPECT(extracted.Size() == 500);
+    EXPECT(set.Size() == expected.size());
+    EXPECT(matches);
+    EXPECT(CheckRedBlack(set) && CheckRedBlack(extracted));
+
+    const auto extractedCount = extracted.Size();
+    const bool erasedExtracted = extracted.EraseRange(0, 10'000) == extractedCount;
+    std::cout << "Erasing all extracted: " << erasedExtracted << ", empty: " << extracted.Empty()
+              << std::endl;
+    EXPECT(erasedExtracted);
+    EXPECT(extracted.Empty() && extracted.Size() == 0);
+    EXPECT(CheckRedBlack(extracted));
+
+    // empty ranges leave the tree as it is
+    const auto sizeBefore = set.Size();
+    EXPECT(set.EraseRange(5'000, 5'000) == 0);
+    EXPECT(set.EraseRange(5'000, 4'000) == 0);
+    EXPECT(set.EraseRange(1'000, 4'000) == 0);
+    EXPECT(set.EraseRange(set.begin(), set.begin()) == set.begin());
+    EXPECT(set.ExtractRange(7'000, 7'000).Empty());
+    EXPECT(set.Size() == sizeBefore);
+    EXPECT(std::equal(set.begin(), set.end(), expected.begin(), expected.end()));
+    EXPECT(CheckRedBlack(set));
+
+    // a range can cover the whole tree
+    ads::RbTree<int> whole{};
+    for (int i = 0; i < 10; ++i) {
+        whole.Insert(i);
+    }
+    whole.EraseRange(whole.begin(), whole.end());
+    const bool erasedAll = whole.Empty() && whole.Size() == 0;
+    for (int i = 0; i < 10; ++i) {
+        whole.Insert(i);
+    }
+    const auto extractedAll = whole.ExtractRange(0, 10);
+    std::cout << "Whole range erased: " << erasedAll << ", extracted: " << extractedAll.Size()
+              << ", left: " << whole.Size() << std::endl;
+    EXPECT(erasedAll);
+    EXPECT(extractedAll.Size() == 10 && whole.Size() == 0 && whole.Empty());
+    EXPECT(whole.begin() == whole.end() && !whole.Min());
+    EXPECT(CheckRedBlack(whole) && CheckRedBlack(extractedAll));
+
+    for (int i = 0; i < 10; ++i) {
+        whole.Insert(i);
+    }
+    EXPECT(whole.EraseRange(-100, 100) == 10 && whole.Empty());
+    whole.Insert(1);
+    EXPECT(whole.Size() == 1 && whole.Contains(1));
+    EXPECT(CheckRedBlack(whole));
+}
+
+static void CheckRbTreeLazyRemove() {
+    std::cout << "\nChecking lazy removing" << std::endl;
+
+    ads::RbTree<int, std::less<int>, ads::NoStats, 0, ads::LazyRemove<50>> set{};
+    std::set<int> expected{};
+    for (int i = 0; i < 1'000; ++i) {
+        set.Insert(i);
+        expected.insert(i);
+    }
+    for (int i = 0; i < 1'000; i += 3) {
+        set.Remove(i);
+        expected.erase(i);
+    }
+    set.Insert(300);  // revives a dead node
+    expected.insert(300);
+
+    const bool matches = std::equal(set.begin(), set.end(), expected.begin(), expected.end());
+    std::cout << "Size: " << set.Size() << ", min: " << set.Min()->m_value
+              << ", 3 is found: " << (set.Find(3) != nullptr) << ", matches std::set: " << matches
+              << std::endl;
+    EXPECT(set.Size() == expected.size());
+    EXPECT(set.Min()->m_value == 1);
+    EXPECT(!set.Find(3) && set.Find(300));
+    EXPECT(matches);
+    EXPECT(CheckRedBlack(set));
+
+    // more than a half of nodes are dead after that, the tree compacts itself
+    for (int i = 1; i < 1'000; i += 3) {
+        set.Remove(i);
+        expected.erase(i);
+    }
+    set.Compact();
+    const bool compactedMatches =
+        std::equal(set.begin(), set.end(), expected.begin(), expected.end());
+    std::cout << "Size after compaction: " << set.Size() << ", matches std::set: "
+              << compactedMatches << std::endl;
+    EXPECT(set.Size() == expected.size());
+    EXPECT(compactedMatches);
+    EXPECT(CheckRedBlack(set));
+}
+
+static void CheckRbTreeRelocation() {
+    std::cout << "\nChecking relocation of nodes" << std::endl;
+
+    using RelocatableSet = ads::RbTree<int, std::less<int>, ads::NoStats, 0, ads::EagerRemove,
+                                       ads::ParentSteps, ads::RelocatableNodes>;
+    std::mt19937 generator{29};
+    RelocatableSet set{};
+    std::set<int> expected{};
+    for (const ads::NodeOrder order : {ads::NodeOrder::BreadthFirst, ads::NodeOrder::VanEmdeBoas}) {
+        for (int i = 0; i < 10'000; ++i) {
+            const int key = static_cast<int>(generator() % 5'000);
+            if (generator() % 3 == 0) {
+                set.Remove(key);
+                expected.erase(key);
+            } else {
+                set.Insert(key);
+                expected.insert(key);
+            }
+        }
+        set.Compact(order);
+
+        const ads::TreeMemoryUsage usage = set.MemoryUsage();
+        const bool arenaHoldsAll = usage.m_arenaBytes >= set.Size() * usage.m_nodeSize;
+        const bool matches = std::equal(set.begin(), set.end(), expected.begin(), expected.end());
+        std::cout << "Size: " << set.Size() << ", on heap: " << usage.m_heapNodeCount
+                  << ", arena holds all: " << arenaHoldsAll << ", matches std::set: " << matches
+                  << std::endl;
+        EXPECT(usage.m_heapNodeCount == 0);
+        EXPECT(arenaHoldsAll);
+        EXPECT(matches);
+        EXPECT(CheckRedBlack(set));
+    }
+
+    // an extracted range shares the arena, new nodes come from the heap
+    RelocatableSet extracted = set.ExtractRange(1'000, 2'000);
+    extracted.Insert(1'000'000);
+    set.Insert(-1);
+    std::cout << "Extracted: " << extracted.Size() << ", on heap: "
+              << extracted.MemoryUsage().m_heapNodeCount
+              << ", left on heap: " << set.MemoryUsage().m_heapNodeCount << std::endl;
+    EXPECT(extracted.MemoryUsage().m_heapNodeCount == 1);
+    EXPECT(set.MemoryUsage().m_heapNodeCount == 1);
+    EXPECT(extracted.Contains(1'000'000) && set.Contains(-1));
+    EXPECT(CheckRedBlack(set) && CheckRedBlack(extracted));
+}
+
+static void CheckRbTreeThreads() {
+    std::cout << "\nChecking threaded iteration" << std::endl;
+
+    using ThreadedSet = ads::RbTree<int, std::less<int>, ads::NoStats, 0, ads::EagerRemove,
+                                    ads::InOrderThreads>;
+    std::mt19937 generator{31};
+    ThreadedSet set{};
+    std::set<int> expected{};
+    for (int i = 0; i < 10'000; ++i) {
+        const int key = static_cast<int>(generator() % 3'000);
+        if (generator() % 3 == 0) {
+            set.Remove(key);
+            expected.erase(key);
+        } else {
+            set.Insert(key);
+            expected.insert(key);
+        }
+    }
+
+    // a range cut out of the tree takes its threads along, the rest is linked over the gap
+    const ThreadedSet extracted = set.ExtractRange(1'000, 2'000);
+    expected.erase(expected.lower_bound(1'000), expected.lower_bound(2'000));
+
+    std::size_t inRange = 0;
+    for (auto it = set.LowerBound(500); it != set.end() && *it < 2'500; ++it) {
+        ++inRange;
+    }
+    const bool matches = std::equal(set.begin(), set.end(), expected.begin(), expected.end());
+    const bool backwards =
+        std::equal(std::make_reverse_iterator(set.end()), std::make_reverse_iterator(set.begin()),
+                   expected.rbegin(), expected.rend());
+    std::cout << "Size: " << set.Size() << ", extracted: " << extracted.Size()
+              << ", in [500, 2500): " << inRange << ", matches std::set: " << matches
+              << ", backwards: " << backwards << std::endl;
+    EXPECT(set.Size() == expected.size());
+    EXPECT(inRange == static_cast<std::size_t>(std::distance(expected.lower_bound(500),
+                                                              expected.lower_bound(2'500))));
+    EXPECT(matches);
+    EXPECT(backwards);
+    EXPECT(std::is_sorted(extracted.begin(), extracted.end()));
+    EXPECT(extracted.LowerBound(1'000) == extracted.begin());
+    EXPECT(extracted.LowerBound(2'000) == extracted.end());
+    EXPECT(CheckRedBlack(set) && CheckRedBlack(extracted));
+}
+
+static void CheckIntrusiveRbTree() {
+    std::cout << "\nChecking intrusive tree" << std::endl;
+
+    std::array<Order, 100> orders{};
+    ads::IntrusiveRbTree<Order, OrderId> index{};
+    for (std::size_t i = 0; i < orders.size(); ++i) {
+        orders[i].m_id = static_cast<int>((i * 37) % orders.size());
+        index.Insert(orders[i]);
+    }
+    for (int id = 0; id < 100; id += 3) {
+        index.Remove(id);
+    }
+    index.Erase(*index.Find(1));
+
+    // a const tree is iterated and searched the same way, it hands out const objects
+    const auto& constIndex = index;
+    int prevId = -1;
+    bool isSorted = true;
+    for (const Order& order : constIndex) {
+        isSorted = isSorted && prevId < order.m_id;
+        prevId = order.m_id;
+    }
+    const Order* pOrder = constIndex.Find(50);
+    static_assert(std::is_same_v<decltype(constIndex.Find(50)), const Order*>);
+    const ads::IntrusiveRbTree<Order, OrderId>::ConstIterator first = index.begin();
+    const bool convertsToConst = first == constIndex.begin();
+    std::cout << "Size: " << index.Size() << ", sorted: " << isSorted
+              << ", order 50 is linked: " << (pOrder == &orders[50 * 73 % 100]) << std::endl;
+    EXPECT(index.Size() == 65);
+    EXPECT(isSorted);
+    EXPECT(pOrder == &orders[50 * 73 % 100]);
+    EXPECT(convertsToConst);
+    EXPECT(!index.Find(1) && !index.Find(3));
+
+    // `std::greater` is not a cheap comparison, equal keys are found after the descent
+    std::array<Order, 10> pairs{};
+    ads::IntrusiveRbTree<Order, OrderId, std::greater<>> descending{};
+    for (std::size_t i = 0; i < pairs.size(); ++i) {
+        pairs[i].m_id = static_cast<int>(i / 2);
+        descending.Insert(pairs[i]);
+    }
+    std::cout << "Descending size: " << descending.Size() << ", first: " << descending.begin()->m_id
+              << ", first of equal keys is linked: " << (descending.Find(3) == &pairs[6])
+              << std::endl;
+    EXPECT(descending.Size() == 5);
+    EXPECT(descending.begin()->m_id == 4);
+    EXPECT(descending.Find(3) == &pairs[6]);
+    EXPECT(descending.Insert(pairs[7]) == &pairs[6]);
+}
+
+static void CheckIntervalTree() {
+    std::cout << "\nChecking interval tree" << std::endl;
+
+    std::mt19937 generator{17};
+    ads::IntervalTree<int, int> tree{};
+    std::vector<ads::Interval<int>> intervals{};
+    for (int i = 0; i < 5'000; ++i) {
+        const int low = static_cast<int>(generator() % 100'000);
+        intervals.push_back({low, low + static_cast<int>(generator() % 1'000)});
+        tree.Insert(intervals.back(), i);
+    }
+    for (std::size_t i = 0; i < intervals.size(); i += 2) {
+        tree.Remove(intervals[i]);
+    }
+
+    std::size_t found = 0;
+    std::size_t expected = 0;
+    tree.Overlapping(40'000, 45'000, [&found](const auto&) { ++found; });
+    for (std::size_t i = 1; i < intervals.size(); i += 2) {
+        expected += intervals[i].m_low <= 45'000 && intervals[i].m_high >= 40'000;
+    }
+    std::size_t stabbed = 0;
+    tree.Stabbing(intervals[1].m_low, [&stabbed](const auto&) { ++stabbed; });
+
+    std::cout << "Size: " << tree.Size() << ", overlapping: " << found << " of " << expected
+              << ", stabbing finds some: " << (stabbed > 0) << std::endl;
+    EXPECT(tree.Size() == 2'500);
+    EXPECT(found == expected);
+    EXPECT(stabbed > 0);
+}
+
+static void CheckRbMultiTree() {
+    std::cout << "\nChecking multi tree" << std::endl;
+
+    std::mt19937 generator{13};
+    ads::RbMultiTree<int> histogram{};
+    std::multiset<int> expected{};
+    for (int i = 0; i < 20'000; ++i) {
+        const int key = static_cast<int>(generator() % 100);
+        if (generator() % 4 == 0) {
+            histogram.RemoveOne(key);
+            if (auto it = expected.find(key); it != expected.end()) {
+                expected.erase(it);
+            }
+        } else {
+            histogram.Insert(key);
+            expected.insert(key);
+        }
+    }
+    histogram.InsertN(1'000, 5);
+    expected.insert({1'000, 1'000, 1'000, 1'000, 1'000});
+    const auto removed = histogram.RemoveAll(7);
+    const auto expectedRemoved = expected.erase(7);
+
+    bool countsMatch = removed == expectedRemoved;
+    for (const auto& [key, count] : histogram.Entries()) {
+        countsMatch = countsMatch && count == expected.count(key);
+    }
+    const bool matches =
+        std::equal(histogram.begin(), histogram.end(), expected.begin(), expected.end());
+    const bool reversed = std::equal(std::make_reverse_iterator(histogram.end()),
+                                     std::make_reverse_iterator(histogram.begin()),
+                                     expected.rbegin(), expected.rend());
+    std::cout << "Size: " << histogram.Size() << ", distinct: " << histogram.DistinctSize()
+              << ", counts match: " << countsMatch << ", matches std::multiset: " << matches
+              << ", reversed: " << reversed << std::endl;
+    EXPECT(histogram.Size() == expected.size());
+    EXPECT(countsMatch);
+    EXPECT(matches);
+    EXPECT(reversed);
+    EXPECT(histogram.RemoveAll(7) == 0 && !histogram.RemoveOne(7));
+}
+
+static void CheckBufferedRbTree() {
+    std::cout << "\nChecking buffered tree" << std::endl;
+
+    std::mt19937 generator{19};
+    ads::BufferedRbTree<std::pair<int, int>> map{64};
+    std::map<int, int> expected{};
+    bool findsMatch = true;
+    for (int i = 0; i < 20'000; ++i) {
+        const int key = static_cast<int>(generator() % 1'000);
+        if (generator() % 4 == 0) {
+            map.Remove(key);
+            expected.erase(key);
+        } else {
+            map.InsertOrUpdate({key, i});
+            expected[key] = i;
+        }
+        const auto pVal = map.Find(key);
+        findsMatch = findsMatch && (pVal ? expected.count(key) && pVal->second == expected[key]
+                                         : !expected.count(key));
+    }
+
+    // a const tree merges its buffer too
+    const ads::BufferedRbTree<std::pair<int, int>>& constMap = map;
+    const auto& tree = constMap.Tree();
+    const bool matches = std::equal(tree.begin(), tree.end(), expected.begin(), expected.end(),
+                                    [](const auto& lhs, const auto& rhs) {
+                                        return lhs.first == rhs.first && lhs.second == rhs.second;
+                                    });
+    std::cout << "Size: " << constMap.Size() << ", finds match: " << findsMatch
+              << ", matches std::map: " << matches << std::endl;
+    EXPECT(constMap.Size() == expected.size());
+    EXPECT(findsMatch);
+    EXPECT(matches);
+}
+
+// a table, which is sorted, deduplicated and laid out at compile time
+constexpr auto kStatusCodes = ads::MakeStaticTree<std::pair<int, std::string_view>>(
+    {{404, "Not Found"}, {200, "OK"}, {500, "Internal Server Error"}, {301, "Moved"},
+     {200, "Duplicate"}});
+static_assert(kStatusCodes.Size() == 4 && kStatusCodes.Find(200)->second == "OK");
+static_assert(!kStatusCodes.Contains(302));
+
+static void CheckSplitRbTree() {
+    std::cout << "\nChecking split tree" << std::endl;
+
+    std::mt19937 generator{23};
+    ads::SplitRbTree<int, std::string> map{};
+    std::map<int, std::string> expected{};
+    const std::string* pPinned = map.TryEmplace(-1, "pinned").first;
+    for (int i = 0; i < 20'000; ++i) {
+        const int key = static_cast<int>(generator() % 1'000);
+        if (generator() % 4 == 0) {
+            map.Remove(key);
+            expected.erase(key);
+        } else {
+            map.InsertOrAssign(key, std::to_string(i) + std::string(32, 'v'));
+            expected[key] = std::to_string(i) + std::string(32, 'v');
+        }
+    }
+
+    std::vector<std::pair<int, std::string>> values{};
+    map.ForEach([&values](int key, const std::string& value) { values.emplace_back(key, value); });
+    expected.emplace(-1, "pinned");
+    const bool matches = values == decltype(values)(expected.begin(), expected.end());
+    std::cout << "Size: " << map.Size() << ", matches std::map: " << matches
+              << ", value kept its address: " << (map.Find(-1) == pPinned) << std::endl;
+    EXPECT(map.Size() == expected.size());
+    EXPECT(matches);
+    EXPECT(map.Find(-1) == pPinned);
+}
+
+static void CheckStaticTree() {
+    std::cout << "\nChecking static tree" << std::endl;
+
+    std::mt19937 generator{23};
+    int found = 0;
+    for (int i = 0; i < 1'000; ++i) {
+        found += kStatusCodes.Contains(static_cast<int>(generator() % 600));
+    }
+    std::cout << "Size: " << kStatusCodes.Size() << ", 404: " << kStatusCodes.Find(404)->second
+              << ", first: " << kStatusCodes.begin()->first << ", found: " << (found > 0)
+              << std::endl;
+    EXPECT(kStatusCodes.Find(404)->second == "Not Found");
+    EXPECT(kStatusCodes.begin()->first == 200);
+    EXPECT(found > 0);
+}
+
+static void CheckTopDownRbTree() {
+    std::cout << "\nChecking top-down tree" << std::endl;
+
+    std::mt19937 generator{11};
+    ads::TopDownRbTree<int> set{};
+    std::set<int> expected{};
+    for (int i = 0; i < 20'000; ++i) {
+        const int key = static_cast<int>(generator() % 5'000);
+        if (generator() % 3 == 0) {
+            set.Remove(key);
+            expected.erase(key);
+        } else {
+            set.Insert(key);
+            expected.insert(key);
+        }
+    }
+
+    const bool matches = std::equal(set.begin(), set.end(), expected.begin(), expected.end());
+    std::cout << "Size: " << set.Size() << ", matches std::set: " << matches << std::endl;
+    EXPECT(set.Size() == expected.size());
+    EXPECT(matches);
+    std::cout << "Node size: " << sizeof(ads::TopDownRbTree<int>::NodeType) << " vs "
+              << sizeof(ads::RbTree<int>::NodeType) << std::endl;
+}
+
+int main() {
+    {
+        CheckRbTreeInsert();
+    }
+    {
+        CheckRbTreeDelete();
+    }
+    {
+        CheckRbTreeSerialization();
+    }
+    {
+        CheckRbTreeStats();
+    }
+    {
+        CheckRbTreeThreeWayCompare();
+    }
+    {
+        CheckRbTreeKeyPrefix();
+    }
+    {
+        CheckRbTreeInlineNodes();
+    }
+    {
+        CheckRbTreeMemoryUsage();
+    }
+    {
+        CheckRbTreeMinMax();
+    }
+    {
+        CheckRbTreeErase();
+    }
+    {
+        CheckRbTreeCursor();
+    }
+    {
+        CheckRbTreeMap();
+    }
+    {
+        CheckRbTreeEraseRange();
+    }
+    {
+        CheckRbTreeLazyRemove();
+    }
+    {
+        CheckRbTreeRelocation();
+    }
+    {
+        CheckRbTreeThreads();
+    }
+    {
+        CheckIntrusiveRbTree();
+    }
+    {
+        CheckIntervalTree();
+    }
+    {
+        CheckRbMultiTree();
+    }
+    {
+        CheckBufferedRbTree();
+    }
+    {
+        CheckSplitRbTree();
+    }
+    {
+        CheckStaticTree();
+    }
+    {
+        CheckTopDownRbTree();
+    }
+    {
+        CheckPersistentRbTree();
+    }
+
+    if (g_failures > 0) {
+        std::cerr << g_failures << " expectations failed" << std::endl;
+        return 1;
+    }
+}
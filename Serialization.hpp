@@ -0,0 +1,247 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ios>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ads {
+
+/// `Serializer` describes how a value is written to and read from a binary stream of a tree.
+/// Trivially copyable values are stored as raw bytes in host byte order, strings and pairs are
+/// supported out of the box. Specialize it to store other types.
+template <typename T, typename = void>
+struct Serializer {
+    static_assert(std::is_trivially_copyable_v<T>, "specialize ads::Serializer for this type");
+
+    template <typename Writer>
+    static void Write(Writer& writer, const T& val) {
+        writer.Write(&val, sizeof(T));
+    }
+
+    template <typename Reader>
+    static void Read(Reader& reader, T& val) {
+        reader.Read(&val, sizeof(T));
+    }
+};
+
+template <>
+struct Serializer<std::string> {
+    // the length comes from the stream, so a string grows by chunks only as its bytes arrive
+    static constexpr std::size_t kChunkSize = 64 * 1024;
+
+    template <typename Writer>
+    static void Write(Writer& writer, const std::string& val) {
+        const std::uint64_t length = val.size();
+        writer.Write(&length, sizeof(length));
+        writer.Write(val.data(), val.size());
+    }
+
+    template <typename Reader>
+    static void Read(Reader& reader, std::string& val) {
+        std::uint64_t length = 0;
+        reader.Read(&length, sizeof(length));
+        val.clear();
+        while (val.size() < length) {
+            const std::size_t offset = val.size();
+            const std::size_t chunk =
+                static_cast<std::size_t>(std::min<std::uint64_t>(length - offset, kChunkSize));
+            val.resize(offset + chunk);
+            reader.Read(val.data() + offset, chunk);
+        }
+    }
+};
+
+template <typename T1, typename T2>
+struct Serializer<std::pair<T1, T2>> {
+    template <typename Writer>
+    static void Write(Writer& writer, const std::pair<T1, T2>& val) {
+        Serializer<T1>::Write(writer, val.first);
+        Serializer<T2>::Write(writer, val.second);
+    }
+
+    template <typename Reader>
+    static void Read(Reader& reader, std::pair<T1, T2>& val) {
+        Serializer<T1>::Read(reader, val.first);
+        Serializer<T2>::Read(reader, val.second);
+    }
+};
+
+namespace internal {
+
+// Header of a serialized tree: magic, format version and number of records which follow in the
+// ascending order.
+inline constexpr char kStreamMagic[8] = {'A', 'D', 'S', 'R', 'B', 'S', '\0', '\0'};
+inline constexpr std::uint64_t kStreamVersion = 1;
+
+class StreamSink {
+public:
+    explicit StreamSink(std::ostream& out) : m_out{out} {}
+
+    void Put(const char* pData, std::size_t size) {
+        if (!m_out.write(pData, static_cast<std::streamsize>(size))) {
+            throw std::ios_base::failure("failed to write a tree");
+        }
+    }
+
+private:
+    std::ostream& m_out;
+};
+
+class FdSink {
+public:
+    explicit FdSink(int fd) : m_fd{fd} {}
+
+    void Put(const char* pData, std::size_t size) {
+        while (size > 0) {
+            const ssize_t written = ::write(m_fd, pData, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "write");
+            }
+            pData += written;
+            size -= static_cast<std::size_t>(written);
+        }
+    }
+
+private:
+    int m_fd;
+};
+
+class StreamSource {
+public:
+    explicit StreamSource(std::istream& in) : m_in{in} {}
+
+    std::size_t Get(char* pData, std::size_t size) {
+        m_in.read(pData, static_cast<std::streamsize>(size));
+        if (m_in.bad()) {
+            throw std::ios_base::failure("failed to read a tree");
+        }
+        return static_cast<std::size_t>(m_in.gcount());
+    }
+
+private:
+    std::istream& m_in;
+};
+
+class FdSource {
+public:
+    explicit FdSource(int fd) : m_fd{fd} {}
+
+    std::size_t Get(char* pData, std::size_t size) {
+        ssize_t bytesRead = 0;
+        do {
+            bytesRead = ::read(m_fd, pData, size);
+        } while (bytesRead < 0 && errno == EINTR);
+
+        if (bytesRead < 0) {
+            throw std::system_error(errno, std::generic_category(), "read");
+        }
+        return static_cast<std::size_t>(bytesRead);
+    }
+
+private:
+    int m_fd;
+};
+
+// `BlockWriter` collects small writes into blocks of `blockSize` bytes before passing them to a
+// sink. Block size 0 disables buffering. Memory usage is bounded by the block size.
+template <typename Sink>
+class BlockWriter {
+public:
+    BlockWriter(Sink sink, std::size_t blockSize) : m_sink{sink} { m_buffer.reserve(blockSize); }
+
+    void Write(const void* pData, std::size_t size) {
+        const char* pBytes = static_cast<const char*>(pData);
+
+        if (m_buffer.size() + size <= m_buffer.capacity()) {
+            m_buffer.insert(m_buffer.end(), pBytes, pBytes + size);
+            return;
+        }
+
+        Flush();
+        if (size < m_buffer.capacity()) {
+            m_buffer.insert(m_buffer.end(), pBytes, pBytes + size);
+        } else {
+            m_sink.Put(pBytes, size);
+        }
+    }
+
+    void Flush() {
+        if (!m_buffer.empty()) {
+            m_sink.Put(m_buffer.data(), m_buffer.size());
+            m_buffer.clear();
+        }
+    }
+
+private:
+    Sink m_sink;
+    std::vector<char> m_buffer;
+};
+
+// `BlockReader` reads a source by blocks of `blockSize` bytes. Block size 0 disables buffering.
+// Throws `std::ios_base::failure` if the source ends before requested bytes are read.
+template <typename Source>
+class BlockReader {
+public:
+    BlockReader(Source source, std::size_t blockSize) : m_source{source}, m_buffer(blockSize) {}
+
+    void Read(void* pData, std::size_t size) {
+        char* pBytes = static_cast<char*>(pData);
+
+        while (size > 0) {
+            if (m_pos == m_end) {
+                if (size >= m_buffer.size()) {
+                    // large reads go straight to the destination
+                    ReadExactly(pBytes, size);
+                    return;
+                }
+                m_pos = 0;
+                m_end = m_source.Get(m_buffer.data(), m_buffer.size());
+                if (m_end == 0) {
+                    throw std::ios_base::failure("unexpected end of a tree stream");
+                }
+            }
+
+            const std::size_t chunk = std::min(size, m_end - m_pos);
+            std::memcpy(pBytes, m_buffer.data() + m_pos, chunk);
+            m_pos += chunk;
+            pBytes += chunk;
+            size -= chunk;
+        }
+    }
+
+private:
+    void ReadExactly(char* pBytes, std::size_t size) {
+        while (size > 0) {
+            const std::size_t bytesRead = m_source.Get(pBytes, size);
+            if (bytesRead == 0) {
+                throw std::ios_base::failure("unexpected end of a tree stream");
+            }
+            pBytes += bytesRead;
+            size -= bytesRead;
+        }
+    }
+
+private:
+    Source m_source;
+    std::vector<char> m_buffer;
+    std::size_t m_pos = 0;
+    std::size_t m_end = 0;
+};
+
+}  // namespace internal
+
+}  // namespace ads
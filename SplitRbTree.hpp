@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "RbTree.hpp"
+
+namespace ads {
+
+namespace internal {
+
+// `ValueSlab` keeps values in chunks of `kChunkSize` slots, so values created one after another
+// are neighbours in memory, and their addresses never change. Freed slots are reused first.
+template <typename M>
+class ValueSlab {
+public:
+    static constexpr std::size_t kChunkSize = 256;
+
+    ValueSlab() = default;
+    ValueSlab(const ValueSlab&) = delete;
+    ValueSlab& operator=(const ValueSlab&) = delete;
+
+    template <typename... Args>
+    M* Create(Args&&... args) {
+        Slot* pSlot = TakeSlot();
+        try {
+            return new (pSlot->m_storage) M(std::forward<Args>(args)...);
+        } catch (...) {
+            PutSlot(pSlot);
+            throw;
+        }
+    }
+
+    void Destroy(M* pValue) noexcept {
+        pValue->~M();
+        PutSlot(reinterpret_cast<Slot*>(pValue));
+    }
+
+    // `Release` frees all chunks, values must be destroyed already.
+    void Release() noexcept {
+        m_chunks.clear();
+        m_pFree = nullptr;
+        m_used = kChunkSize;
+    }
+
+private:
+    union Slot {
+        Slot* m_pNext;
+        alignas(M) std::byte m_storage[sizeof(M)];
+    };
+
+    Slot* TakeSlot() {
+        if (m_pFree) {
+            return std::exchange(m_pFree, m_pFree->m_pNext);
+        }
+        if (m_used == kChunkSize) {
+            m_chunks.emplace_back(new Slot[kChunkSize]);
+            m_used = 0;
+        }
+        return &m_chunks.back()[m_used++];
+    }
+
+    void PutSlot(Slot* pSlot) noexcept {
+        pSlot->m_pNext = m_pFree;
+        m_pFree = pSlot;
+    }
+
+private:
+    std::vector<std::unique_ptr<Slot[]>> m_chunks;
+    Slot* m_pFree = nullptr;          // the list of freed slots
+    std::size_t m_used = kChunkSize;  // used slots of the last chunk
+};
+
+}  // namespace internal
+
+/// `SplitRbTree` maps keys to values, which are kept out of the tree: a node holds the links, the
+/// key and a pointer to the value in a slab. A descent reads only small nodes, so more of them fit
+/// into the cache, and the value costs one extra indirection after the node is found. It pays off
+/// for values of a few cache lines, small values are better kept in nodes of `RbTree`.
+///
+/// Values are never moved, pointers returned by `Find` stay valid until the key is removed. The
+/// tree is neither copyable nor movable.
+template <typename K, typename M, typename Cmp = std::less<K>, typename StatsPolicy = NoStats>
+class SplitRbTree {
+public:
+    using key_type = K;
+    using value_type = M;
+    using compare = Cmp;
+    using size_type = std::size_t;
+    using TreeType = RbTree<std::pair<K, M*>, Cmp, StatsPolicy>;
+
+public:
+    SplitRbTree() = default;
+    SplitRbTree(const SplitRbTree&) = delete;
+    SplitRbTree& operator=(const SplitRbTree&) = delete;
+
+    ~SplitRbTree() { Clear(); }
+
+public:
+    /// Size returns current number of elements in container.
+    size_type Size() const noexcept { return m_tree.Size(); }
+
+    /// Empty returns true if size of container is 0, false otherwise.
+    bool Empty() const noexcept { return m_tree.Empty(); }
+
+    /// Clear removes all elements from the container and frees the slab.
+    void Clear() noexcept {
+        for (const auto& [key, pValue] : m_tree) {
+            m_values.Destroy(pValue);
+        }
+        m_tree.Clear();
+        m_values.Release();
+    }
+
+    /// Tree returns the tree of keys and pointers to values.
+    const TreeType& Tree() const noexcept { return m_tree; }
+
+public:
+    /// TryEmplace constructs a value from `args` only if `key` is not in the tree. Returns the
+    /// value of `key` and true if it was inserted.
+    template <typename... Args>
+    std::pair<M*, bool> TryEmplace(const key_type& key, Args&&... args) {
+        const auto [pNode, inserted] = m_tree.TryEmplace(key, nullptr);
+        if (inserted) {
+            try {
+                pNode->m_value.second = m_values.Create(std::forward<Args>(args)...);
+            } catch (...) {
+                m_tree.Erase(pNode);
+                throw;
+            }
+        }
+        return {pNode->m_value.second, inserted};
+    }
+
+    /// InsertOrAssign assigns `value` to the value of `key` in place or inserts a new one. Returns
+    /// the value of `key` and true if it was inserted.
+    template <typename T>
+    std::pair<M*, bool> InsertOrAssign(const key_type& key, T&& value) {
+        const auto [pNode, inserted] = m_tree.TryEmplace(key, nullptr);
+        if (inserted) {
+            try {
+                pNode->m_value.second = m_values.Create(std::forward<T>(value));
+            } catch (...) {
+                m_tree.Erase(pNode);
+                throw;
+            }
+        } else {
+            *pNode->m_value.second = std::forward<T>(value);
+        }
+        return {pNode->m_value.second, inserted};
+    }
+
+    /// Find returns the value of `key` or `nullptr`.
+    M* Find(const key_type& key) noexcept {
+        const auto pNode = m_tree.Find(key);
+        return pNode ? pNode->m_value.second : nullptr;
+    }
+
+    const M* Find(const key_type& key) const noexcept {
+        return const_cast<SplitRbTree&>(*this).Find(key);
+    }
+
+    /// Contains returns true if there is a value with `key`.
+    bool Contains(const key_type& key) const noexcept { return m_tree.Contains(key); }
+
+    /// `Remove` removes `key` and destroys its value.
+    void Remove(const key_type& key) noexcept {
+        const auto pNode = m_tree.Find(key);
+        if (pNode) {
+            m_values.Destroy(pNode->m_value.second);
+            m_tree.Erase(pNode);
+        }
+    }
+
+    /// ForEach calls `fn(key, value)` for all values in the ascending order of keys.
+    template <typename Fn>
+    void ForEach(Fn&& fn) const {
+        for (const auto& [key, pValue] : m_tree) {
+            fn(key, static_cast<const M&>(*pValue));
+        }
+    }
+
+private:
+    TreeType m_tree;
+    internal::ValueSlab<M> m_values;
+};
+
+}  // namespace ads
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <functional>
+
+#include "RbTree.hpp"
+
+namespace ads {
+
+/// `StaticTree` is a read-only table of at most `N` values sorted by keys. It is a flat array, so a
+/// table built by `MakeStaticTree` is a constant in the data section: no allocation and no work at
+/// startup. `Find` is a binary search, which works both in constant expressions and at runtime.
+template <typename V,
+          std::size_t N,
+          typename Cmp = std::less<typename internal::KeyValueType<V>::key_type>>
+class StaticTree {
+public:
+    using key_value_type = V;
+    using key_type = typename internal::KeyValueType<V>::key_type;
+    using compare = Cmp;
+    using size_type = std::size_t;
+
+public:
+    constexpr StaticTree() = default;
+
+    /// Builds a table from values of `tree` in order, `tree` must have at most `N` of them.
+    constexpr explicit StaticTree(const RbTree<V, Cmp>& tree) {
+        for (const V& val : tree) {
+            m_values[m_size++] = val;
+        }
+    }
+
+public:
+    /// Size returns a number of values in the table.
+    constexpr size_type Size() const noexcept { return m_size; }
+
+    /// Empty returns true if size of container is 0, false otherwise.
+    constexpr bool Empty() const noexcept { return m_size == 0; }
+
+    constexpr const V* begin() const noexcept { return m_values.data(); }
+    constexpr const V* end() const noexcept { return m_values.data() + m_size; }
+
+    /// Find returns the value with `key` or `nullptr`.
+    constexpr const V* Find(const key_type& key) const noexcept {
+        size_type lo = 0;
+        size_type hi = m_size;
+        // the first value, which is not less than `key`, is in [lo, hi]
+        while (lo < hi) {
+            const size_type mid = lo + (hi - lo) / 2;
+            if (Less(internal::Key(m_values[mid]), key)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo == m_size || Less(key, internal::Key(m_values[lo]))) {
+            return nullptr;
+        }
+        return &m_values[lo];
+    }
+
+    /// Contains returns true if there is a value with `key`.
+    constexpr bool Contains(const key_type& key) const noexcept { return Find(key) != nullptr; }
+
+private:
+    constexpr bool Less(const key_type& lhs, const key_type& rhs) const noexcept {
+        if constexpr (internal::IsThreeWayCompare<compare, key_type>) {
+            return m_compare(lhs, rhs) < 0;
+        } else {
+            return m_compare(lhs, rhs);
+        }
+    }
+
+private:
+    std::array<V, N> m_values{};
+    size_type m_size = 0;
+    [[no_unique_address]] compare m_compare{};
+};
+
+/// MakeStaticTree inserts `values` into an `RbTree` at compile time and returns its values as a
+/// `StaticTree`. The first of equal keys is kept, like `Insert` does.
+/// `constexpr auto kCodes = MakeStaticTree<std::pair<int, std::string_view>>({{404, "..."}});`
+template <typename V,
+          typename Cmp = std::less<typename internal::KeyValueType<V>::key_type>,
+          std::size_t N>
+consteval StaticTree<V, N, Cmp> MakeStaticTree(const V (&values)[N]) {
+    RbTree<V, Cmp> tree{};
+    for (const V& val : values) {
+        tree.Insert(val);
+    }
+    return StaticTree<V, N, Cmp>{tree};
+}
+
+}  // namespace ads
@@ -0,0 +1,403 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#include "RbTree.hpp"
+
+namespace ads {
+
+namespace internal {
+
+// `TopDownNodeBase` has no parent link: a top-down tree never walks up, so a node is 8 bytes
+// smaller than `NodeBase` and rotations store fewer links.
+struct TopDownNodeBase {
+    Color m_color;
+    TopDownNodeBase* m_link[2];  // left and right children, indexed by direction
+};
+
+template <typename T>
+struct TopDownNode : public TopDownNodeBase {
+    T m_value;
+};
+
+// Height of a red-black tree is at most 2 * log2(n + 1). Nodes take more than 16 bytes and 64-bit
+// platforms address at most 2^48 bytes, so there are less than 2^44 nodes.
+inline constexpr std::size_t kTopDownMaxHeight = 2 * 44;
+
+}  // namespace internal
+
+/// `TopDownRbTree` is a red-black tree without parent links. Insertion and removal rebalance the
+/// tree in a single pass on the way down (color flips and rotations are done before a node is
+/// reached), so they never walk back up. Iterators keep the path from the root in a bounded
+/// stack instead.
+///
+/// `Remove` of a node with two children moves the value of its in-order predecessor into it, so
+/// it invalidates pointers and iterators to the removed value and to its predecessor.
+template <typename V, typename Cmp = std::less<typename internal::KeyValueType<V>::key_type>>
+class TopDownRbTree {
+public:
+    using key_value_type = V;
+    using key_type = typename internal::KeyValueType<V>::key_type;
+    using value_type = typename internal::KeyValueType<V>::value_type;
+    using compare = Cmp;
+    using size_type = std::size_t;
+
+    using NodeType = internal::TopDownNode<key_value_type>;
+    using NodePtr = NodeType*;
+    using BaseType = internal::TopDownNodeBase;
+    using BasePtr = internal::TopDownNodeBase*;
+
+    /// `ConstIterator` walks the tree in order with a stack of nodes whose left subtree is being
+    /// visited.
+    class ConstIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = key_value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const key_value_type*;
+        using reference = const key_value_type&;
+
+        ConstIterator() noexcept = default;
+
+        reference operator*() const noexcept { return Top()->m_value; }
+        pointer operator->() const noexcept { return &Top()->m_value; }
+
+        ConstIterator& operator++() noexcept {
+            BasePtr pNode = m_path[--m_depth];
+            PushLeftPath(pNode->m_link[1]);
+            return *this;
+        }
+
+        ConstIterator operator++(int) noexcept {
+            ConstIterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const ConstIterator& other) const noexcept {
+            return m_depth == other.m_depth &&
+                   (m_depth == 0 || m_path[m_depth - 1] == other.m_path[other.m_depth - 1]);
+        }
+        bool operator!=(const ConstIterator& other) const noexcept { return !(*this == other); }
+
+    private:
+        friend class TopDownRbTree;
+
+        explicit ConstIterator(BasePtr pRoot) noexcept { PushLeftPath(pRoot); }
+
+        NodePtr Top() const noexcept { return static_cast<NodePtr>(m_path[m_depth - 1]); }
+
+        void PushLeftPath(BasePtr pNode) noexcept {
+            while (pNode) {
+                m_path[m_depth++] = pNode;
+                pNode = pNode->m_link[0];
+            }
+        }
+
+    private:
+        std::array<BasePtr, internal::kTopDownMaxHeight> m_path{};
+        std::size_t m_depth = 0;
+    };
+
+public:
+    TopDownRbTree() = default;
+
+    TopDownRbTree(const TopDownRbTree&) = delete;
+    TopDownRbTree& operator=(const TopDownRbTree&) = delete;
+
+    TopDownRbTree(TopDownRbTree&& other) noexcept
+        : m_pRoot{std::exchange(other.m_pRoot, nullptr)},
+          m_size{std::exchange(other.m_size, 0)},
+          m_compare{std::move(other.m_compare)} {}
+
+    TopDownRbTree& operator=(TopDownRbTree&& other) noexcept {
+        if (this != std::addressof(other)) {
+            Clear();
+            m_pRoot = std::exchange(other.m_pRoot, nullptr);
+            m_size = std::exchange(other.m_size, 0);
+            m_compare = std::move(other.m_compare);
+        }
+        return *this;
+    }
+
+    /// Destructor removes all nodes of a tree.
+    ~TopDownRbTree() { Clear(); }
+
+public:
+    /// Size returns current number of elements in container.
+    size_type Size() const noexcept { return m_size; }
+
+    /// Empty returns true if size of container is 0, false otherwise.
+    bool Empty() const noexcept { return m_size == 0; }
+
+    /// Clear removes all elements. Nodes are freed by rotating left children up, so it takes
+    /// O(n) time and no extra memory.
+    void Clear() noexcept {
+        BasePtr pCurrNode = m_pRoot;
+
+        while (pCurrNode) {
+            BasePtr pLeft = pCurrNode->m_link[0];
+            if (pLeft) {
+                pCurrNode->m_link[0] = pLeft->m_link[1];
+                pLeft->m_link[1] = pCurrNode;
+                pCurrNode = pLeft;
+            } else {
+                BasePtr pRight = pCurrNode->m_link[1];
+                delete static_cast<NodePtr>(pCurrNode);
+                pCurrNode = pRight;
+            }
+        }
+
+        m_pRoot = nullptr;
+        m_size = 0;
+    }
+
+    ConstIterator begin() const noexcept { return ConstIterator{m_pRoot}; }
+    ConstIterator end() const noexcept { return ConstIterator{}; }
+
+public:
+    /// Insert adds a new value to the container only if it is not presented in the tree.
+    NodePtr Insert(const key_value_type& val) { return InsertInternal(val); }
+
+    /// InsertOrUpdate adds new value to the tree or update already existing one.
+    NodePtr InsertOrUpdate(const key_value_type& val) { return InsertInternal(val, true); }
+
+    /// Find returns a node, which holds a `key`.
+    NodePtr Find(const key_type& key) const noexcept {
+        BasePtr pCurrNode = m_pRoot;
+
+        while (pCurrNode) {
+            const key_type& currKey = KeyOf(pCurrNode);
+
+            if (m_compare(key, currKey)) {
+                pCurrNode = pCurrNode->m_link[0];
+            } else if (m_compare(currKey, key)) {
+                pCurrNode = pCurrNode->m_link[1];
+            } else {
+                return static_cast<NodePtr>(pCurrNode);
+            }
+        }
+
+        return nullptr;
+    }
+
+    /// Contains retuns true if value with `key` is presented in the tree.
+    bool Contains(const key_type& key) const noexcept { return Find(key) != nullptr; }
+
+    /// `Remove` removes element with `key`. Red nodes are pushed down in front of the search, so
+    /// the node, which is finally unlinked, is red and no fix-up is needed afterwards.
+    void Remove(const key_type& key) noexcept {
+        if (!m_pRoot) {
+            return;
+        }
+
+        BaseType head{};  // fake parent of the root
+        head.m_link[1] = m_pRoot;
+
+        BasePtr pCurrNode = &head;
+        BasePtr pParent = nullptr;
+        BasePtr pGrandParent = nullptr;
+        BasePtr pFound = nullptr;
+        std::size_t dir = 1;
+
+        while (pCurrNode->m_link[dir]) {
+            const std::size_t last = dir;
+
+            pGrandParent = pParent;
+            pParent = pCurrNode;
+            pCurrNode = pCurrNode->m_link[dir];
+
+            const key_type& currKey = KeyOf(pCurrNode);
+            dir = m_compare(currKey, key);
+            if (!dir && !m_compare(key, currKey)) {
+                pFound = pCurrNode;
+            }
+
+            if (IsRed(pCurrNode) || IsRed(pCurrNode->m_link[dir])) {
+                continue;
+            }
+
+            if (IsRed(pCurrNode->m_link[!dir])) {
+                pParent = pParent->m_link[last] = Rotate(pCurrNode, dir);
+                continue;
+            }
+
+            BasePtr pSibling = pParent->m_link[!last];
+            if (!pSibling) {
+                continue;
+            }
+
+            if (!IsRed(pSibling->m_link[0]) && !IsRed(pSibling->m_link[1])) {
+                // color flip
+                pParent->m_color = internal::Color::Black;
+                pSibling->m_color = internal::Color::Red;
+                pCurrNode->m_color = internal::Color::Red;
+            } else {
+                const std::size_t dir2 = pGrandParent->m_link[1] == pParent;
+
+                if (IsRed(pSibling->m_link[last])) {
+                    pGrandParent->m_link[dir2] = DoubleRotate(pParent, last);
+                } else {
+                    pGrandParent->m_link[dir2] = Rotate(pParent, last);
+                }
+
+                BasePtr pSubtree = pGrandParent->m_link[dir2];
+                pCurrNode->m_color = internal::Color::Red;
+                pSubtree->m_color = internal::Color::Red;
+                pSubtree->m_link[0]->m_color = internal::Color::Black;
+                pSubtree->m_link[1]->m_color = internal::Color::Black;
+            }
+        }
+
+        if (pFound) {
+            // `pCurrNode` is the in-order predecessor of `pFound` or `pFound` itself
+            if (pFound != pCurrNode) {
+                static_cast<NodePtr>(pFound)->m_value =
+                    std::move(static_cast<NodePtr>(pCurrNode)->m_value);
+            }
+            pParent->m_link[pParent->m_link[1] == pCurrNode] =
+                pCurrNode->m_link[pCurrNode->m_link[0] == nullptr];
+            delete static_cast<NodePtr>(pCurrNode);
+            --m_size;
+        }
+
+        m_pRoot = head.m_link[1];
+        if (m_pRoot) {
+            m_pRoot->m_color = internal::Color::Black;
+        }
+    }
+
+private:
+    static const key_type& KeyOf(BasePtr pNode) noexcept {
+        return KeyOfValue(static_cast<NodePtr>(pNode)->m_value);
+    }
+
+    static bool IsRed(BasePtr pNode) noexcept {
+        return pNode && pNode->m_color == internal::Color::Red;
+    }
+
+    // `Rotate` rotates `pRoot` in direction `dir` and returns the new root of the subtree. The old
+    // root becomes red and the new one black.
+    static BasePtr Rotate(BasePtr pRoot, std::size_t dir) noexcept {
+        BasePtr pSubtree = pRoot->m_link[!dir];
+
+        pRoot->m_link[!dir] = pSubtree->m_link[dir];
+        pSubtree->m_link[dir] = pRoot;
+
+        pRoot->m_color = internal::Color::Red;
+        pSubtree->m_color = internal::Color::Black;
+
+        return pSubtree;
+    }
+
+    static BasePtr DoubleRotate(BasePtr pRoot, std::size_t dir) noexcept {
+        pRoot->m_link[!dir] = Rotate(pRoot->m_link[!dir], !dir);
+        return Rotate(pRoot, dir);
+    }
+
+    // `InsertInternal` splits 4-nodes (black nodes with two red children) by a color flip on the
+    // way down and fixes red violations with rotations right away, so the new leaf can be linked
+    // without walking back.
+    NodePtr InsertInternal(const key_value_type& val, bool updateIfExists = false) {
+        const key_type& keyToInsert = KeyOfValue(val);
+
+        if (!m_pRoot) {
+            NodePtr pNewNode = AllocateNode(val, internal::Color::Black);
+            m_pRoot = pNewNode;
+            ++m_size;
+            return pNewNode;
+        }
+
+        BaseType head{};  // fake parent of the root
+        head.m_color = internal::Color::Black;
+        head.m_link[1] = m_pRoot;
+
+        BasePtr pGreatGrandParent = &head;
+        BasePtr pGrandParent = nullptr;
+        BasePtr pParent = nullptr;
+        BasePtr pCurrNode = m_pRoot;
+        NodePtr pResult = nullptr;
+        std::size_t dir = 0;
+        std::size_t last = 0;
+
+        for (;;) {
+            if (!pCurrNode) {
+                pResult = AllocateNode(val, internal::Color::Red);
+                pCurrNode = pResult;
+                pParent->m_link[dir] = pCurrNode;
+                ++m_size;
+            } else if (IsRed(pCurrNode->m_link[0]) && IsRed(pCurrNode->m_link[1])) {
+                // color flip
+                pCurrNode->m_color = internal::Color::Red;
+                pCurrNode->m_link[0]->m_color = internal::Color::Black;
+                pCurrNode->m_link[1]->m_color = internal::Color::Black;
+            }
+
+            if (IsRed(pCurrNode) && IsRed(pParent)) {
+                const std::size_t dir2 = pGreatGrandParent->m_link[1] == pGrandParent;
+
+                if (pCurrNode == pParent->m_link[last]) {
+                    pGreatGrandParent->m_link[dir2] = Rotate(pGrandParent, !last);
+                } else {
+                    pGreatGrandParent->m_link[dir2] = DoubleRotate(pGrandParent, !last);
+                }
+            }
+
+            if (pResult) {
+                break;
+            }
+
+            const key_type& currKey = KeyOf(pCurrNode);
+            if (m_compare(keyToInsert, currKey)) {
+                last = dir;
+                dir = 0;
+            } else if (m_compare(currKey, keyToInsert)) {
+                last = dir;
+                dir = 1;
+            } else {
+                pResult = static_cast<NodePtr>(pCurrNode);
+                if (updateIfExists) {
+                    pResult->m_value = val;
+                }
+                break;
+            }
+
+            if (pGrandParent) {
+                pGreatGrandParent = pGrandParent;
+            }
+            pGrandParent = pParent;
+            pParent = pCurrNode;
+            pCurrNode = pCurrNode->m_link[dir];
+        }
+
+        m_pRoot = head.m_link[1];
+        m_pRoot->m_color = internal::Color::Black;
+
+        return pResult;
+    }
+
+    static NodePtr AllocateNode(const key_value_type& val, internal::Color color) {
+        NodePtr pNode = new NodeType{{color, {nullptr, nullptr}}, val};
+        return pNode;
+    }
+
+    static const key_type& KeyOfValue(const key_value_type& val) noexcept {
+        if constexpr (std::is_same_v<key_type, key_value_type>) {
+            return val;
+        } else {
+            return val.first;
+        }
+    }
+
+private:
+    BasePtr m_pRoot = nullptr;
+    size_type m_size = 0;
+    compare m_compare{};
+};
+
+}  // namespace ads